@@ -0,0 +1,433 @@
+/*!\file audio_analysis.cpp
+ *
+ * \brief analyse des blocs audio par FFT fenêtrée vectorisée. Voir
+ * audio_analysis.h.
+ */
+#include "audio_analysis.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define AA_X86 1
+#  include <immintrin.h>
+/* le noyau AVX2 est compilé pour sa cible uniquement, le choix se
+ * fait à l'exécution */
+#  define AA_TARGET_AVX2 __attribute__((target("avx2")))
+#  if defined(__SSE2__)
+#    define AA_HAS_SSE2 1
+#  endif
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  define AA_X86 1
+#  include <immintrin.h>
+#  include <intrin.h>
+#  define AA_TARGET_AVX2
+#  if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define AA_HAS_SSE2 1
+#  endif
+#endif
+
+#ifndef M_PI
+#  define M_PI 3.14159265358979323846
+#endif
+
+/* fréquences extrêmes du découpage en bandes */
+#define AA_FMIN 30.0
+#define AA_FMAX 16000.0
+/* alignement des buffers (une ligne de cache, suffisant pour l'AVX) */
+#define AA_ALIGN 64
+
+struct aa_analyzer_t {
+  int n, nbands, rate, simd;
+  /* position d'écriture dans la fenêtre glissante (échantillon le plus ancien) */
+  int pos;
+  /* tous les tableaux suivants pointent dans block */
+  void * block;
+  float * ring;          /* n échantillons mono, fenêtre glissante */
+  float * window;        /* n coefficients de Hann */
+  float * re, * im;      /* n, parties réelles et imaginaires */
+  float * twr, * twi;    /* n - 1 facteurs de rotation, rangés par étage */
+  float * mag;           /* n / 2 + 1 magnitudes */
+  int   * bitrev;        /* n indices de permutation */
+  int   edges[AA_MAX_BANDS + 1];
+  float prev_bands[AA_MAX_BANDS];
+};
+
+static void * alignedAlloc(size_t size) {
+#if defined(_MSC_VER)
+  return _aligned_malloc(size, AA_ALIGN);
+#else
+  void * p = NULL;
+  if(posix_memalign(&p, AA_ALIGN, size))
+    return NULL;
+  return p;
+#endif
+}
+
+static void alignedFree(void * p) {
+#if defined(_MSC_VER)
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+/* retourne le meilleur niveau de vectorisation supporté par le CPU */
+static int cpuSimd(void) {
+#if defined(AA_X86) && defined(__GNUC__)
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    return AA_SIMD_AVX2;
+#  if defined(AA_HAS_SSE2)
+  return AA_SIMD_SSE2;
+#  else
+  return __builtin_cpu_supports("sse2") ? AA_SIMD_SSE2 : AA_SIMD_SCALAR;
+#  endif
+#elif defined(AA_X86) && defined(_MSC_VER)
+  int r[4];
+  __cpuid(r, 0);
+  if(r[0] >= 7) {
+    __cpuidex(r, 7, 0);
+    if(r[1] & (1 << 5))
+      return AA_SIMD_AVX2;
+  }
+  return AA_SIMD_SSE2;
+#else
+  return AA_SIMD_SCALAR;
+#endif
+}
+
+static int ilog2(int n) {
+  int l = 0;
+  while((1 << l) < n) ++l;
+  return l;
+}
+
+aa_analyzer_t * aaNew(int fft_size, int nbands, int rate) {
+  int i, b, l, n = fft_size, h;
+  size_t nf, off = 0;
+  double fmax;
+  aa_analyzer_t * aa;
+  char * p;
+  if(n < 64 || n > AA_MAX_FFT || (n & (n - 1)) || nbands < 1 || nbands > AA_MAX_BANDS ||
+     nbands > n / 2 || rate <= 0)
+    return NULL;
+  if(!(aa = (aa_analyzer_t *)calloc(1, sizeof *aa)))
+    return NULL;
+  aa->n = n;
+  aa->nbands = nbands;
+  aa->rate = rate;
+  /* un seul bloc aligné : ring, window, re, im (n chacun), twr, twi
+   * (n chacun, le dernier reste inutilisé), mag (n / 2 + 1 arrondi),
+   * bitrev (n) ; chaque tableau commence sur un multiple de AA_ALIGN */
+  nf = (size_t)n * sizeof(float);
+  if(!(aa->block = alignedAlloc(8 * nf + (size_t)n * sizeof(int)))) {
+    free(aa);
+    return NULL;
+  }
+  p = (char *)aa->block;
+  aa->ring   = (float *)(p + off); off += nf;
+  aa->window = (float *)(p + off); off += nf;
+  aa->re     = (float *)(p + off); off += nf;
+  aa->im     = (float *)(p + off); off += nf;
+  aa->twr    = (float *)(p + off); off += nf;
+  aa->twi    = (float *)(p + off); off += nf;
+  aa->mag    = (float *)(p + off); off += 2 * nf;
+  aa->bitrev = (int   *)(p + off);
+  /* fenêtre de Hann périodique */
+  for(i = 0; i < n; ++i)
+    aa->window[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * i / n));
+  /* permutation par inversion des bits */
+  l = ilog2(n);
+  for(i = 0; i < n; ++i) {
+    int r = 0, x = i;
+    for(b = 0; b < l; ++b, x >>= 1)
+      r = (r << 1) | (x & 1);
+    aa->bitrev[i] = r;
+  }
+  /* facteurs de rotation : l'étage de demi-taille h commence à
+   * l'indice h - 1 (1 + 2 + ... + h / 2) */
+  for(h = 1; h < n; h <<= 1)
+    for(i = 0; i < h; ++i) {
+      aa->twr[h - 1 + i] = (float)cos(-M_PI * i / h);
+      aa->twi[h - 1 + i] = (float)sin(-M_PI * i / h);
+    }
+  /* bornes des bandes, espacées logarithmiquement entre AA_FMIN et
+   * AA_FMAX (ou Nyquist), au moins un bin par bande */
+  fmax = rate / 2.0 < AA_FMAX ? rate / 2.0 : AA_FMAX;
+  for(b = 0; b <= nbands; ++b) {
+    double f = AA_FMIN * pow(fmax / AA_FMIN, (double)b / nbands);
+    int k = (int)floor(f * n / rate + 0.5);
+    if(b > 0 && k <= aa->edges[b - 1])
+      k = aa->edges[b - 1] + 1;
+    aa->edges[b] = k < n / 2 + 1 ? k : n / 2 + 1;
+  }
+  /* plus de bandes que de bins au-dessus de AA_FMIN : les dernières
+   * seraient vides (moyenne sur 0 bin) */
+  if(aa->edges[nbands] - aa->edges[nbands - 1] < 1) {
+    aaDelete(aa);
+    return NULL;
+  }
+  aa->simd = cpuSimd();
+  aaReset(aa);
+  return aa;
+}
+
+void aaDelete(aa_analyzer_t * aa) {
+  if(!aa) return;
+  alignedFree(aa->block);
+  free(aa);
+}
+
+int aaSetSimd(aa_analyzer_t * aa, int wanted) {
+  int best = cpuSimd();
+  aa->simd = wanted < best ? (wanted < 0 ? AA_SIMD_SCALAR : wanted) : best;
+  return aa->simd;
+}
+
+const char * aaSimdName(int simd) {
+  switch(simd) {
+  case AA_SIMD_AVX2: return "avx2";
+  case AA_SIMD_SSE2: return "sse2";
+  default:           return "scalar";
+  }
+}
+
+void aaReset(aa_analyzer_t * aa) {
+  memset(aa->ring, 0, aa->n * sizeof *aa->ring);
+  memset(aa->prev_bands, 0, sizeof aa->prev_bands);
+  aa->pos = 0;
+}
+
+/* un étage de papillons de demi-taille h, version scalaire */
+static void stageScalar(float * re, float * im, const float * wr, const float * wi, int n, int h) {
+  int i, k;
+  for(i = 0; i < n; i += 2 * h)
+    for(k = 0; k < h; ++k) {
+      int a = i + k, b = a + h;
+      float vr = re[b] * wr[k] - im[b] * wi[k];
+      float vi = re[b] * wi[k] + im[b] * wr[k];
+      re[b] = re[a] - vr; im[b] = im[a] - vi;
+      re[a] += vr;        im[a] += vi;
+    }
+}
+
+static void fftScalar(aa_analyzer_t * aa) {
+  int h;
+  for(h = 1; h < aa->n; h <<= 1)
+    stageScalar(aa->re, aa->im, aa->twr + h - 1, aa->twi + h - 1, aa->n, h);
+}
+
+static void magScalar(aa_analyzer_t * aa, int from, float scale) {
+  int k;
+  for(k = from; k <= aa->n / 2; ++k)
+    aa->mag[k] = scale * sqrtf(aa->re[k] * aa->re[k] + aa->im[k] * aa->im[k]);
+}
+
+#if defined(AA_HAS_SSE2)
+static void fftSSE2(aa_analyzer_t * aa) {
+  int h, i, k, n = aa->n;
+  float * re = aa->re, * im = aa->im;
+  for(h = 1; h < 4; h <<= 1)
+    stageScalar(re, im, aa->twr + h - 1, aa->twi + h - 1, n, h);
+  for(; h < n; h <<= 1) {
+    const float * wr = aa->twr + h - 1, * wi = aa->twi + h - 1;
+    for(i = 0; i < n; i += 2 * h)
+      for(k = 0; k < h; k += 4) {
+        float * ar = re + i + k, * ai = im + i + k, * br = ar + h, * bi = ai + h;
+        __m128 twr = _mm_loadu_ps(wr + k), twi = _mm_loadu_ps(wi + k);
+        __m128 xr = _mm_load_ps(br), xi = _mm_load_ps(bi);
+        __m128 vr = _mm_sub_ps(_mm_mul_ps(xr, twr), _mm_mul_ps(xi, twi));
+        __m128 vi = _mm_add_ps(_mm_mul_ps(xr, twi), _mm_mul_ps(xi, twr));
+        __m128 ur = _mm_load_ps(ar), ui = _mm_load_ps(ai);
+        _mm_store_ps(ar, _mm_add_ps(ur, vr)); _mm_store_ps(ai, _mm_add_ps(ui, vi));
+        _mm_store_ps(br, _mm_sub_ps(ur, vr)); _mm_store_ps(bi, _mm_sub_ps(ui, vi));
+      }
+  }
+}
+
+static void magSSE2(aa_analyzer_t * aa, float scale) {
+  int k, half = aa->n / 2;
+  __m128 s = _mm_set1_ps(scale);
+  for(k = 0; k < half; k += 4) {
+    __m128 r = _mm_load_ps(aa->re + k), i = _mm_load_ps(aa->im + k);
+    _mm_store_ps(aa->mag + k, _mm_mul_ps(s, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(i, i)))));
+  }
+  magScalar(aa, half, scale);
+}
+#endif
+
+#if defined(AA_X86)
+AA_TARGET_AVX2 static void fftAVX2(aa_analyzer_t * aa) {
+  int h, i, k, n = aa->n;
+  float * re = aa->re, * im = aa->im;
+  for(h = 1; h < 8; h <<= 1)
+    stageScalar(re, im, aa->twr + h - 1, aa->twi + h - 1, n, h);
+  for(; h < n; h <<= 1) {
+    const float * wr = aa->twr + h - 1, * wi = aa->twi + h - 1;
+    for(i = 0; i < n; i += 2 * h)
+      for(k = 0; k < h; k += 8) {
+        float * ar = re + i + k, * ai = im + i + k, * br = ar + h, * bi = ai + h;
+        __m256 twr = _mm256_loadu_ps(wr + k), twi = _mm256_loadu_ps(wi + k);
+        __m256 xr = _mm256_load_ps(br), xi = _mm256_load_ps(bi);
+        __m256 vr = _mm256_sub_ps(_mm256_mul_ps(xr, twr), _mm256_mul_ps(xi, twi));
+        __m256 vi = _mm256_add_ps(_mm256_mul_ps(xr, twi), _mm256_mul_ps(xi, twr));
+        __m256 ur = _mm256_load_ps(ar), ui = _mm256_load_ps(ai);
+        _mm256_store_ps(ar, _mm256_add_ps(ur, vr)); _mm256_store_ps(ai, _mm256_add_ps(ui, vi));
+        _mm256_store_ps(br, _mm256_sub_ps(ur, vr)); _mm256_store_ps(bi, _mm256_sub_ps(ui, vi));
+      }
+  }
+}
+
+AA_TARGET_AVX2 static void magAVX2(aa_analyzer_t * aa, float scale) {
+  int k, half = aa->n / 2;
+  __m256 s = _mm256_set1_ps(scale);
+  for(k = 0; k < half; k += 8) {
+    __m256 r = _mm256_load_ps(aa->re + k), i = _mm256_load_ps(aa->im + k);
+    _mm256_store_ps(aa->mag + k, _mm256_mul_ps(s, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(r, r), _mm256_mul_ps(i, i)))));
+  }
+  _mm256_zeroupper();
+  magScalar(aa, half, scale);
+}
+#endif
+
+/* statistiques temporelles d'un bloc et recopie de sa version mono
+ * dans la fenêtre glissante */
+typedef struct {
+  float sq[2], abs[2], peak;
+} block_stats_t;
+
+static void convertScalar(aa_analyzer_t * aa, const int16_t * s16, int frames, int channels, block_stats_t * st) {
+  const float sc = 1.0f / 32768.0f;
+  int i, c, mask = aa->n - 1, nc = channels < 2 ? 1 : 2;
+  for(i = 0; i < frames; ++i) {
+    float m = 0.0f;
+    for(c = 0; c < nc; ++c) {
+      float v = s16[i * channels + c] * sc, a = fabsf(v);
+      st->sq[c] += v * v;
+      st->abs[c] += a;
+      if(a > st->peak) st->peak = a;
+      m += v;
+    }
+    aa->ring[aa->pos] = m / nc;
+    aa->pos = (aa->pos + 1) & mask;
+  }
+}
+
+#if defined(AA_HAS_SSE2)
+/* cas stéréo : 4 trames (8 échantillons) par itération, en segments
+ * contigus de la fenêtre glissante */
+static void convertStereoSSE2(aa_analyzer_t * aa, const int16_t * s16, int frames, block_stats_t * st) {
+  const __m128 sc = _mm_set1_ps(1.0f / 32768.0f), half = _mm_set1_ps(0.5f);
+  const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 sql = _mm_setzero_ps(), sqr = _mm_setzero_ps(), abl = _mm_setzero_ps(), abr = _mm_setzero_ps(), pk = _mm_setzero_ps();
+  float t[4];
+  int mask = aa->n - 1;
+  while(frames >= 4) {
+    int seg = aa->n - aa->pos, i;
+    /* réaligner la position d'écriture sur 4 trames */
+    if(aa->pos & 3) {
+      seg = 4 - (aa->pos & 3);
+      convertScalar(aa, s16, seg, 2, st);
+      s16 += 2 * seg;
+      frames -= seg;
+      continue;
+    }
+    if(seg > frames) seg = frames;
+    seg &= ~3;
+    for(i = 0; i < seg; i += 4) {
+      __m128i v  = _mm_loadu_si128((const __m128i *)(s16 + 2 * i));
+      __m128  lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), sc);
+      __m128  hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), sc);
+      __m128  l  = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+      __m128  r  = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+      __m128  al = _mm_and_ps(l, absmask), ar = _mm_and_ps(r, absmask);
+      sql = _mm_add_ps(sql, _mm_mul_ps(l, l));
+      sqr = _mm_add_ps(sqr, _mm_mul_ps(r, r));
+      abl = _mm_add_ps(abl, al);
+      abr = _mm_add_ps(abr, ar);
+      pk  = _mm_max_ps(pk, _mm_max_ps(al, ar));
+      _mm_store_ps(aa->ring + aa->pos + i, _mm_mul_ps(_mm_add_ps(l, r), half));
+    }
+    aa->pos = (aa->pos + seg) & mask;
+    s16 += 2 * seg;
+    frames -= seg;
+  }
+  _mm_storeu_ps(t, sql); st->sq[0]  += t[0] + t[1] + t[2] + t[3];
+  _mm_storeu_ps(t, sqr); st->sq[1]  += t[0] + t[1] + t[2] + t[3];
+  _mm_storeu_ps(t, abl); st->abs[0] += t[0] + t[1] + t[2] + t[3];
+  _mm_storeu_ps(t, abr); st->abs[1] += t[0] + t[1] + t[2] + t[3];
+  _mm_storeu_ps(t, pk);
+  for(int i = 0; i < 4; ++i)
+    if(t[i] > st->peak) st->peak = t[i];
+  /* reste éventuel */
+  convertScalar(aa, s16, frames, 2, st);
+}
+#endif
+
+void aaProcessS16(aa_analyzer_t * aa, const int16_t * s16, int frames, int channels, aa_features_t * out) {
+  block_stats_t st;
+  int i, b, k, n = aa->n, mask = n - 1;
+  float flux = 0.0f;
+  memset(&st, 0, sizeof st);
+  memset(out, 0, sizeof *out);
+  out->nbands = aa->nbands;
+  if(frames <= 0 || channels <= 0)
+    return;
+  /* 1. statistiques temporelles et fenêtre glissante */
+#if defined(AA_HAS_SSE2)
+  if(channels == 2 && aa->simd >= AA_SIMD_SSE2)
+    convertStereoSSE2(aa, s16, frames, &st);
+  else
+#endif
+    convertScalar(aa, s16, frames, channels, &st);
+  if(channels < 2) {
+    st.sq[1] = st.sq[0];
+    st.abs[1] = st.abs[0];
+  }
+  out->rms[0] = sqrtf(st.sq[0] / frames);
+  out->rms[1] = sqrtf(st.sq[1] / frames);
+  out->peak = st.peak < 1.0f ? st.peak : 1.0f;
+  /* même échelle que l'ancienne moyenne (valeurs absolues / 2^13) */
+  out->level = 4.0f * (st.abs[0] + st.abs[1]) / (2.0f * frames);
+  if(out->level > 1.0f) out->level = 1.0f;
+  /* 2. fenêtrage, permutation et FFT */
+  for(i = 0; i < n; ++i) {
+    int j = aa->bitrev[i];
+    aa->re[j] = aa->ring[(aa->pos + i) & mask] * aa->window[i];
+    aa->im[j] = 0.0f;
+  }
+  /* normalisation : une sinusoïde pleine échelle donne ~1 */
+  switch(aa->simd) {
+#if defined(AA_X86)
+  case AA_SIMD_AVX2:
+    fftAVX2(aa);
+    magAVX2(aa, 4.0f / n);
+    break;
+#endif
+#if defined(AA_HAS_SSE2)
+  case AA_SIMD_SSE2:
+    fftSSE2(aa);
+    magSSE2(aa, 4.0f / n);
+    break;
+#endif
+  default:
+    fftScalar(aa);
+    magScalar(aa, 0, 4.0f / n);
+    break;
+  }
+  /* 3. bandes logarithmiques et flux */
+  for(b = 0; b < aa->nbands; ++b) {
+    float s = 0.0f, v;
+    for(k = aa->edges[b]; k < aa->edges[b + 1]; ++k)
+      s += aa->mag[k];
+    s /= aa->edges[b + 1] - aa->edges[b];
+    v = 1.0f + 20.0f * log10f(s + 1e-9f) / 60.0f;
+    v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+    out->bands[b] = v;
+    if(v > aa->prev_bands[b])
+      flux += v - aa->prev_bands[b];
+    aa->prev_bands[b] = v;
+  }
+  out->flux = flux / aa->nbands;
+}
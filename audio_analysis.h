@@ -0,0 +1,75 @@
+/*!\file audio_analysis.h
+ *
+ * \brief analyse des blocs audio reçus par la callBack de SDL_mixer :
+ * RMS par canal, crête, spectre en bandes logarithmiques et flux
+ * spectral, obtenus par une FFT fenêtrée (Hann) vectorisée
+ * (AVX2/SSE2 avec repli scalaire).
+ *
+ * Tous les buffers sont alloués (et alignés) une seule fois par
+ * aaNew ; aaProcessS16 n'alloue rien et peut donc être appelée depuis
+ * le thread audio.
+ */
+#ifndef _AUDIO_ANALYSIS_H
+#define _AUDIO_ANALYSIS_H
+
+#include <stdint.h>
+
+/*!\brief nombre maximal de bandes du spectre. */
+#define AA_MAX_BANDS 64
+/*!\brief taille maximale de la FFT (puissance de 2). */
+#define AA_MAX_FFT   8192
+
+/*!\brief niveaux de vectorisation utilisables par l'analyseur. */
+enum {
+  AA_SIMD_SCALAR = 0,
+  AA_SIMD_SSE2,
+  AA_SIMD_AVX2
+};
+
+/*!\brief caractéristiques extraites d'un bloc audio. Toutes les
+ * valeurs sont normalisées dans [0, 1]. */
+typedef struct aa_features_t aa_features_t;
+struct aa_features_t {
+  /*!\brief RMS du bloc, canal gauche puis canal droit. */
+  float rms[2];
+  /*!\brief crête absolue du bloc (tous canaux). */
+  float peak;
+  /*!\brief flux spectral : somme des hausses d'énergie des bandes
+   * depuis le bloc précédent, ramenée au nombre de bandes. */
+  float flux;
+  /*!\brief niveau global, calculé comme l'ancienne moyenne des
+   * valeurs absolues (x4, saturée à 1). */
+  float level;
+  /*!\brief nombre de bandes effectivement renseignées. */
+  int nbands;
+  /*!\brief énergie de chaque bande, en dB ramenés à [0, 1] (-60dB -> 0). */
+  float bands[AA_MAX_BANDS];
+};
+
+typedef struct aa_analyzer_t aa_analyzer_t;
+
+/*!\brief créé un analyseur pour une FFT de \a fft_size points (une
+ * puissance de 2 entre 64 et AA_MAX_FFT), \a nbands bandes
+ * logarithmiques (entre 1 et AA_MAX_BANDS, chacune d'au moins un bin,
+ * donc au plus fft_size / 2) et une fréquence d'échantillonnage \a
+ * rate. Retourne NULL si les paramètres sont invalides ou si
+ * l'allocation échoue. */
+extern aa_analyzer_t * aaNew(int fft_size, int nbands, int rate);
+/*!\brief libère l'analyseur \a aa. */
+extern void            aaDelete(aa_analyzer_t * aa);
+/*!\brief choisit le niveau de vectorisation \a wanted (AA_SIMD_*) ;
+ * il est ramené au meilleur niveau supporté par le CPU. Retourne le
+ * niveau effectif. */
+extern int             aaSetSimd(aa_analyzer_t * aa, int wanted);
+/*!\brief retourne le nom du niveau de vectorisation \a simd. */
+extern const char *    aaSimdName(int simd);
+/*!\brief remet à zéro l'historique (fenêtre glissante et spectre
+ * précédent) de l'analyseur. */
+extern void            aaReset(aa_analyzer_t * aa);
+/*!\brief analyse \a frames trames entrelacées de \a channels canaux
+ * 16 bits signés. Le bloc est ajouté à la fenêtre glissante de la FFT
+ * (qui porte donc sur les fft_size derniers échantillons, quelle que
+ * soit la taille du bloc) et le résultat est écrit dans \a out. */
+extern void            aaProcessS16(aa_analyzer_t * aa, const int16_t * s16, int frames, int channels, aa_features_t * out);
+
+#endif
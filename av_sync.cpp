@@ -0,0 +1,171 @@
+/*!\file av_sync.cpp
+ *
+ * \brief compensation de la latence son-image. Voir av_sync.h.
+ */
+#include "av_sync.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* taille de l'historique pour remonter jusqu'au bloc entendu : les
+ * tampons, la latence et la fenêtre, plus une marge ; la latence est
+ * réduite à ce que AS_HISTORY blocs couvrent. Un changement de taille
+ * vide l'historique, qui se remplit en quelques blocs. */
+static void dimensionner(as_sync_t * as) {
+  double max = (AS_HISTORY - AS_MARGIN) * as->block - as->buffers - as->window;
+  int n, size = 1;
+  if(as->latency > max) {
+    fprintf(stderr, "asInit: latence %.0f ms trop longue pour l'historique, ramenee a %.0f ms\n",
+	    as->latency * 1000.0, max * 1000.0);
+    as->latency = max;
+  }
+  n = (int)ceil((as->buffers + as->latency + as->window) / as->block) + AS_MARGIN;
+  while(size < n)
+    size <<= 1;
+  if(size > AS_HISTORY)
+    size = AS_HISTORY;
+  if(size != as->size) {
+    as->size = size;
+    as->head = as->count = 0;
+  }
+}
+
+void asInit(as_sync_t * as, int rate, int buffer_frames, int fft_size, double latency) {
+  memset(as, 0, sizeof *as);
+  /* SDL garde en général deux périodes en file devant le périphérique */
+  as->buffers = 2.0 * buffer_frames / rate;
+  as->window = fft_size / (double)rate;
+  as->block = buffer_frames / (double)rate;
+  as->latency = latency;
+  dimensionner(as);
+}
+
+/* instant du flux représenté par un bloc : milieu de la fenêtre
+ * d'analyse, qui se termine avec le bloc */
+static double instant(const as_sync_t * as, const fr_frame_t * fr) {
+  return fr->t + fr->duration - 0.5 * as->window;
+}
+
+void asPush(as_sync_t * as, const fr_frame_t * fr) {
+  int i, n;
+  /* horloge : les callBacks arrivent en retard, jamais en avance */
+  as->offsets[as->noffsets++ % AS_CLOCK_WINDOW] = fr->wall - fr->t;
+  n = as->noffsets < AS_CLOCK_WINDOW ? as->noffsets : AS_CLOCK_WINDOW;
+  as->offset = as->offsets[0];
+  for(i = 1; i < n; ++i)
+    if(as->offsets[i] < as->offset)
+      as->offset = as->offsets[i];
+  /* bloc non analysé (pré-analyse prête) : horloge seulement */
+  if(fr->f.nbands <= 0)
+    return;
+  as->history[as->head] = *fr;
+  as->head = (as->head + 1) & (as->size - 1);
+  if(as->count < as->size)
+    ++as->count;
+}
+
+int asReady(const as_sync_t * as) {
+  return as->noffsets > 0;
+}
+
+double asHeard(const as_sync_t * as, double wall) {
+  return wall - as->offset - as->buffers - as->latency;
+}
+
+static float borner(float v, float max) {
+  return v < 0.0f ? 0.0f : (v > max ? max : v);
+}
+
+/* a + (b - a) * x, x pouvant dépasser 1 (extrapolation) */
+static void melanger(const aa_features_t * a, const aa_features_t * b, float x, aa_features_t * out) {
+  int i;
+  out->nbands = b->nbands;
+  for(i = 0; i < 2; ++i)
+    out->rms[i] = borner(a->rms[i] + (b->rms[i] - a->rms[i]) * x, 1.0f);
+  out->peak = borner(a->peak + (b->peak - a->peak) * x, 1.0f);
+  out->level = borner(a->level + (b->level - a->level) * x, 1.0f);
+  out->flux = borner(a->flux + (b->flux - a->flux) * x, 1e30f);
+  for(i = 0; i < b->nbands; ++i)
+    out->bands[i] = borner(a->bands[i] + (b->bands[i] - a->bands[i]) * x, 1.0f);
+}
+
+/* k-ième bloc de l'historique en partant du plus récent (k = 0) */
+static const fr_frame_t * bloc(const as_sync_t * as, int k) {
+  return &as->history[(as->head - 1 - k) & (as->size - 1)];
+}
+
+int asSample(const as_sync_t * as, double t, aa_features_t * out) {
+  const fr_frame_t * a, * b;
+  int k;
+  if(!as->count) {
+    memset(out, 0, sizeof *out);
+    return 0;
+  }
+  b = bloc(as, 0);
+  if(t >= instant(as, b)) {
+    /* au-delà du dernier bloc : extrapolation d'au plus un bloc */
+    double x = (t - instant(as, b)) / b->duration;
+    if(as->count == 1) {
+      *out = b->f;
+      return 1;
+    }
+    melanger(&bloc(as, 1)->f, &b->f, 1.0f + (float)(x < 1.0 ? x : 1.0), out);
+    return 1;
+  }
+  for(k = 1; k < as->count; ++k) {
+    a = bloc(as, k);
+    if(instant(as, a) <= t) {
+      double d;
+      b = bloc(as, k - 1);
+      d = instant(as, b) - instant(as, a);
+      melanger(&a->f, &b->f, d > 0.0 ? (float)((t - instant(as, a)) / d) : 1.0f, out);
+      return 1;
+    }
+  }
+  /* plus ancien que l'historique */
+  *out = bloc(as, as->count - 1)->f;
+  return 1;
+}
+
+void asCalibrationStart(as_sync_t * as) {
+  as->calibrating = 1;
+  as->ntaps = 0;
+}
+
+void asTap(as_sync_t * as, double wall) {
+  if(as->calibrating && as->ntaps < AS_TAPS)
+    as->taps[as->ntaps++] = wall;
+}
+
+static int comparer(const void * a, const void * b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+double asCalibrationEnd(as_sync_t * as, fc_cache_t * fc, double start) {
+  double ecarts[AS_TAPS], periode, m;
+  int i, n = 0;
+  as->calibrating = 0;
+  if(!fc || fcStatus(fc) != FC_READY || fcTempo(fc) <= 0.0f)
+    return 0.0;
+  periode = 60.0 / fcTempo(fc);
+  /* frappe entendue -> instant du flux avec la latence actuelle, puis
+   * position dans le morceau, puis écart au beat le plus proche
+   * (valable à une demi-période près) */
+  for(i = 0; i < as->ntaps; ++i) {
+    double t = asHeard(as, as->taps[i]) - start, beat;
+    if(t < 0.0)
+      continue;
+    beat = fcNextBeat(fc, t - 0.5 * periode);
+    if(beat >= 0.0)
+      ecarts[n++] = t - beat;
+  }
+  if(n < 4)
+    return 0.0;
+  qsort(ecarts, n, sizeof *ecarts, comparer);
+  m = ecarts[n / 2];
+  as->latency += m;
+  dimensionner(as);
+  return m;
+}
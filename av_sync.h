@@ -0,0 +1,85 @@
+/*!\file av_sync.h
+ *
+ * \brief compensation de la latence son-image, côté rendu.
+ *
+ * Les blocs analysés sont horodatés dans le flux audio (compte des
+ * échantillons, l'horloge du périphérique) ; la correspondance avec
+ * l'horloge murale est estimée par le minimum glissant de (instant de
+ * la callBack - position du bloc), les callBacks pouvant être en
+ * retard mais jamais en avance. Un bloc mixé n'est entendu qu'après
+ * les tampons du périphérique (deux périodes) et la latence de la
+ * chaîne de diffusion (réglable ou calibrée).
+ *
+ * draw échantillonne alors, dans un court historique de blocs, les
+ * caractéristiques (interpolées, ou extrapolées au-delà du dernier
+ * bloc) à l'instant du flux qui sera entendu quand la frame sera
+ * affichée.
+ *
+ * Calibration : l'utilisateur tape en rythme sur ce qu'il entend ;
+ * l'écart médian entre ses frappes et la grille de beats de la
+ * pré-analyse corrige la latence de diffusion.
+ */
+#ifndef _AV_SYNC_H
+#define _AV_SYNC_H
+
+#include "feature_ring.h"
+#include "feature_cache.h"
+
+/*!\brief blocs gardés au plus dans l'historique (puissance de 2) ;
+ * asInit n'en utilise que ce que la latence demande. */
+#define AS_HISTORY 1024
+/*!\brief blocs de marge de l'historique au-delà de la latence. */
+#define AS_MARGIN 8
+/*!\brief callBacks sur lesquels l'horloge est estimée. */
+#define AS_CLOCK_WINDOW 32
+/*!\brief frappes au plus pour une calibration. */
+#define AS_TAPS 64
+
+typedef struct as_sync_t as_sync_t;
+struct as_sync_t {
+  /*!\brief latence des tampons du périphérique et latence de
+   * diffusion (secondes), durée de la fenêtre d'analyse et d'un
+   * bloc. */
+  double buffers, latency, window, block;
+  /*!\brief estimation courante de (instant mural - instant du flux)
+   * au mixage, et dernières valeurs mesurées. */
+  double offset, offsets[AS_CLOCK_WINDOW];
+  int noffsets;
+  /*!\brief historique des blocs, par instant du flux croissant ;
+   * seuls les \a size premiers (puissance de 2) servent. */
+  fr_frame_t history[AS_HISTORY];
+  int head, count, size;
+  /*!\brief calibration en cours et frappes (instants muraux). */
+  int calibrating, ntaps;
+  double taps[AS_TAPS];
+};
+
+/*!\brief initialise \a as pour des tampons de \a buffer_frames trames
+ * à \a rate Hz, une FFT de \a fft_size points et une latence de
+ * diffusion \a latency (secondes). L'historique couvre les tampons,
+ * la latence et la fenêtre ; une latence trop longue pour AS_HISTORY
+ * blocs est réduite (avec un avertissement). */
+extern void   asInit(as_sync_t * as, int rate, int buffer_frames, int fft_size, double latency);
+/*!\brief ajoute le bloc \a fr (retiré de l'anneau) à l'historique et
+ * met à jour l'estimation d'horloge. */
+extern void   asPush(as_sync_t * as, const fr_frame_t * fr);
+/*!\brief retourne 1 si au moins un bloc a été reçu. */
+extern int    asReady(const as_sync_t * as);
+/*!\brief instant du flux (secondes) entendu à l'instant mural \a wall. */
+extern double asHeard(const as_sync_t * as, double wall);
+/*!\brief caractéristiques à l'instant du flux \a t, interpolées entre
+ * deux blocs de l'historique ou extrapolées (d'au plus un bloc) après
+ * le dernier. Retourne 0 (et \a out à zéro) si l'historique est vide. */
+extern int    asSample(const as_sync_t * as, double t, aa_features_t * out);
+/*!\brief commence une calibration (efface les frappes). */
+extern void   asCalibrationStart(as_sync_t * as);
+/*!\brief enregistre une frappe à l'instant mural \a wall. */
+extern void   asTap(as_sync_t * as, double wall);
+/*!\brief termine la calibration : corrige la latence de diffusion par
+ * l'écart médian des frappes à la grille de beats de \a fc (prête),
+ * pré-analyse du morceau commencé à l'instant du flux \a start (0
+ * sans liste) ; les frappes antérieures sont ignorées. Retourne la
+ * correction en secondes, ou 0 si moins de 4 frappes. */
+extern double asCalibrationEnd(as_sync_t * as, fc_cache_t * fc, double start);
+
+#endif
@@ -0,0 +1,380 @@
+/*!\file bench.cpp
+ *
+ * \brief banc d'essai (cible make bench) des chemins critiques :
+ * analyse spectrale de mixCallback sur signaux synthétique et réel,
+ * décodage, conversion et transfert des textures, envoi par frame des
+ * blocs d'uniformes et des matrices, et images par seconde de la
+ * scène complète rendue hors ligne (contexte GL sans écran).
+ *
+ * Les résultats sont écrits en JSON (par défaut bench.json) pour
+ * suivre les régressions d'une construction à l'autre :
+ *
+ * ./light_n_tex_bench [FICHIER.json]
+ */
+#include <GL4D/gl4duw_SDL2.h>
+#include <SDL_image.h>
+#include <SDL_mixer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "audio_analysis.h"
+#include "uniform_blocks.h"
+#include "workers.h"
+#include "textures.h"
+#include "offline.h"
+#include "shader_variants.h"
+#include "transforms.h"
+
+#ifdef _WIN32
+#  define popen  _popen
+#  define pclose _pclose
+#endif
+
+/* nombre maximal de résultats et de mesures par résultat */
+#define NB_RESULTATS 128
+#define NB_MESURES   (1 << 16)
+/* durée (s) et fréquence du signal synthétique */
+#define DUREE_SIGNAL 10
+#define FREQUENCE    44100
+/* frames de la scène rendues hors ligne */
+#define FRAMES_SCENE 300
+
+typedef struct resultat_t resultat_t;
+struct resultat_t {
+  char name[96];
+  const char * unit;
+  int n;
+  double median, mean, min, p99, extra;
+  const char * extra_name;
+};
+
+static resultat_t _resultats[NB_RESULTATS];
+static int _nresultats = 0;
+static double _mesures[NB_MESURES];
+static int _nmesures = 0;
+
+static double maintenant(void) {
+  return SDL_GetPerformanceCounter() / (double)SDL_GetPerformanceFrequency();
+}
+
+static int comparer(const void * a, const void * b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* ajoute une mesure (en secondes) à la série courante */
+static void mesure(double s) {
+  if(_nmesures < NB_MESURES)
+    _mesures[_nmesures++] = s;
+}
+
+/* clôt la série courante sous le nom \a name, en \a unit ("us" ou "ms") */
+static resultat_t * resultat(const char * name, const char * unit) {
+  resultat_t * r;
+  double echelle = strcmp(unit, "us") ? 1e3 : 1e6, somme = 0.0;
+  int i;
+  if(_nresultats >= NB_RESULTATS || !_nmesures) {
+    _nmesures = 0;
+    return NULL;
+  }
+  r = &_resultats[_nresultats++];
+  memset(r, 0, sizeof *r);
+  snprintf(r->name, sizeof r->name, "%s", name);
+  r->unit = unit;
+  qsort(_mesures, _nmesures, sizeof *_mesures, comparer);
+  for(i = 0; i < _nmesures; ++i)
+    somme += _mesures[i];
+  r->n = _nmesures;
+  r->min = _mesures[0] * echelle;
+  r->median = _mesures[_nmesures / 2] * echelle;
+  r->p99 = _mesures[(_nmesures * 99) / 100] * echelle;
+  r->mean = somme / _nmesures * echelle;
+  fprintf(stderr, "%-44s %8d x  med %10.3f %s  moy %10.3f  min %10.3f  p99 %10.3f\n",
+	  r->name, r->n, r->median, unit, r->mean, r->min, r->p99);
+  _nmesures = 0;
+  return r;
+}
+
+/* signal stéréo synthétique : trois sinusoïdes, des impulsions et du
+ * bruit (générateur congruentiel, reproductible) */
+static int16_t * synthetique(int frames) {
+  int16_t * s = (int16_t *)malloc(frames * 2 * sizeof *s);
+  unsigned graine = 12345u;
+  int i;
+  if(!s)
+    return NULL;
+  for(i = 0; i < frames; ++i) {
+    double t = i / (double)FREQUENCE, v;
+    graine = graine * 1664525u + 1013904223u;
+    v = 0.3 * sin(2.0 * M_PI * 55.0 * t) + 0.2 * sin(2.0 * M_PI * 440.0 * t) + 0.1 * sin(2.0 * M_PI * 5000.0 * t);
+    v += 0.05 * ((graine >> 9) / (double)(1 << 23) - 1.0);
+    if(i % (FREQUENCE / 2) < 256)
+      v += 0.3;
+    s[2 * i] = s[2 * i + 1] = (int16_t)(v * 32767.0 * 0.9);
+  }
+  return s;
+}
+
+/* analyse par blocs de chaque taille et à chaque niveau SIMD */
+static void benchAnalyse(const char * signal, const int16_t * pcm, int frames) {
+  static const int tailles[] = { 128, 256, 512, 1024, 2048 };
+  static const int simds[] = { AA_SIMD_SCALAR, AA_SIMD_SSE2, AA_SIMD_AVX2 };
+  aa_features_t f;
+  unsigned t, s;
+  for(s = 0; s < sizeof simds / sizeof *simds; ++s) {
+    aa_analyzer_t * aa = aaNew(1024, 32, FREQUENCE);
+    if(!aa)
+      return;
+    if(aaSetSimd(aa, simds[s]) != simds[s]) {
+      aaDelete(aa);
+      continue;
+    }
+    for(t = 0; t < sizeof tailles / sizeof *tailles; ++t) {
+      char name[96];
+      resultat_t * r;
+      int i;
+      aaReset(aa);
+      for(i = 0; i + tailles[t] <= frames; i += tailles[t]) {
+	double t0 = maintenant();
+	aaProcessS16(aa, pcm + 2 * i, tailles[t], 2, &f);
+	mesure(maintenant() - t0);
+      }
+      snprintf(name, sizeof name, "analyse/%s/%s/%d", signal, aaSimdName(simds[s]), tailles[t]);
+      /* facteur temps réel : durée du bloc sur temps d'analyse */
+      if((r = resultat(name, "us"))) {
+	r->extra_name = "realtime_factor";
+	r->extra = tailles[t] / (double)FREQUENCE * 1e6 / r->median;
+      }
+    }
+    aaDelete(aa);
+  }
+}
+
+/* décodage, conversion et transfert d'une image, puis chargement
+ * asynchrone complet (cache de mipmaps chaud après le premier) */
+static void benchTexture(const char * path) {
+  SDL_Surface * s = NULL, * c = NULL;
+  GLuint tex;
+  int i;
+  for(i = 0; i < 5; ++i) {
+    double t0 = maintenant();
+    if(!(s = IMG_Load(path)))
+      return;
+    mesure(maintenant() - t0);
+    if(i < 4) SDL_FreeSurface(s);
+  }
+  resultat("texture/decode", "ms");
+  for(i = 0; i < 10; ++i) {
+    double t0 = maintenant();
+    c = SDL_ConvertSurfaceFormat(s, SDL_PIXELFORMAT_RGBA32, 0);
+    mesure(maintenant() - t0);
+    if(i < 9) SDL_FreeSurface(c);
+  }
+  resultat("texture/convert", "ms");
+  glGenTextures(1, &tex);
+  glBindTexture(GL_TEXTURE_2D, tex);
+  /* glFinish : on mesure le transfert effectif, pas sa mise en file */
+  for(i = 0; i < 10; ++i) {
+    double t0 = maintenant();
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, c->w, c->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, c->pixels);
+    glFinish();
+    mesure(maintenant() - t0);
+  }
+  resultat("texture/upload", "ms");
+  for(i = 0; i < 10; ++i) {
+    double t0 = maintenant();
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glFinish();
+    mesure(maintenant() - t0);
+  }
+  resultat("texture/generate_mipmap", "ms");
+  /* un chargement non mesuré remplit le cache : les mesures ne
+   * portent que sur des chargements depuis le cache */
+  txLoadAsync(tex, path, 0);
+  txFinish();
+  glFinish();
+  for(i = 0; i < 5; ++i) {
+    double t0 = maintenant();
+    txLoadAsync(tex, path, 0);
+    txFinish();
+    glFinish();
+    mesure(maintenant() - t0);
+  }
+  resultat("texture/load_async_cached", "ms");
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDeleteTextures(1, &tex);
+  SDL_FreeSurface(c);
+  SDL_FreeSurface(s);
+}
+
+/* envoi par frame de l'éclairage, des matériaux et des
+ * transformations (dont la matrice des normales) de \a nobjets objets,
+ * sans dessin : noeuds animés (transforms.h) composés puis transférés
+ * avec les blocs d'uniformes */
+static void benchSoumission(int nobjets) {
+  static const GLfloat vue[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, -5, 0, 0, 0, 1 };
+  char name[96];
+  int i, k;
+  if(!svInit("shaders/light_n_tex.vs", "shaders/light_n_tex.fs", ubBindProgram) || !ubInit(nobjets, nobjets) ||
+     !tfInit(nobjets, nobjets)) {
+    ubQuit();
+    return;
+  }
+  if(!svUse(SV_TEXTURE)) {
+    tfQuit();
+    ubQuit();
+    return;
+  }
+  /* T(k, 1.5, 0) x Ry(i + k) pour l'objet k à l'itération i */
+  for(k = 0; k < nobjets; ++k) {
+    tfNode(-1, k, 1.5f, 0, 0, 1, 0, 0, 1);
+    tfBind(k, TF_ANGLE, 0, k, 1.0f, 1);
+  }
+  for(i = 0; i < 2000; ++i) {
+    double t0 = maintenant();
+    float source = i;
+    ub_light_t * l = ubBeginFrame();
+    memset(l, 0, sizeof *l);
+    tfUpdate(&source);
+    for(k = 0; k < nobjets; ++k) {
+      ub_material_t * m = ubMaterial(k);
+      ub_object_t * o = ubObject(k);
+      GLfloat n[9];
+      int j;
+      memset(m, 0, sizeof *m);
+      m->diffuse[0] = m->diffuse[3] = 1.0f;
+      m->mult_tex_coord = 1.0f;
+      memcpy(o->model, tfWorld(k), sizeof o->model);
+      svNormalMatrix(vue, tfWorld(k), n);
+      for(j = 0; j < 3; ++j)
+	memcpy(o->normal_matrix + 4 * j, n + 3 * j, 3 * sizeof *n);
+      o->displacement = 0.0f;
+    }
+    ubFlush();
+    gl4duSendMatrices();
+    for(k = 0; k < nobjets; ++k) {
+      ubUseObject(k);
+      ubUseMaterial(k);
+    }
+    ubEndFrame();
+    mesure(maintenant() - t0);
+  }
+  glUseProgram(0);
+  glFinish();
+  snprintf(name, sizeof name, "draw/submission/%d_objects", nobjets);
+  resultat(name, "us");
+  svQuit();
+  tfQuit();
+  ubQuit();
+}
+
+/* images par seconde de la scène : le programme principal est lancé
+ * en rendu hors ligne et son bilan (sur stderr) est relu */
+static void benchScene(const char * taille) {
+  char cmd[256], ligne[256], name[96];
+  double ips = -1.0;
+  int frames = 0;
+  FILE * p;
+  resultat_t * r;
+  snprintf(cmd, sizeof cmd, "./light_n_tex -horsligne - -frames %d -taille %s 2>&1 1>%s",
+	   FRAMES_SCENE, taille,
+#ifdef _WIN32
+	   "NUL"
+#else
+	   "/dev/null"
+#endif
+	   );
+  if(!(p = popen(cmd, "r")))
+    return;
+  while(fgets(ligne, sizeof ligne, p)) {
+    const char * s = strstr(ligne, "Hors ligne: ");
+    const char * o = strrchr(ligne, '(');
+    if(s && o && sscanf(s, "Hors ligne: %d frames", &frames) == 1)
+      sscanf(o, "(%lf", &ips);
+  }
+  pclose(p);
+  if(ips <= 0.0 || frames <= 0) {
+    fprintf(stderr, "scene/%s : echec du rendu hors ligne\n", taille);
+    return;
+  }
+  /* une seule mesure : la durée moyenne d'une frame */
+  mesure(1.0 / ips);
+  snprintf(name, sizeof name, "scene/offline/%s", taille);
+  if((r = resultat(name, "ms"))) {
+    r->extra_name = "fps";
+    r->extra = ips;
+  }
+}
+
+static int ecrire(const char * path) {
+  FILE * f;
+  int i;
+  char date[32];
+  time_t t = time(NULL);
+  strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%S", localtime(&t));
+  if(!(f = fopen(path, "w")))
+    return 0;
+  fprintf(f, "{\n  \"date\": \"%s\",\n  \"cpus\": %d,\n  \"renderer\": \"%s\",\n  \"results\": [\n",
+	  date, SDL_GetCPUCount(), (const char *)glGetString(GL_RENDERER));
+  for(i = 0; i < _nresultats; ++i) {
+    const resultat_t * r = &_resultats[i];
+    fprintf(f, "    {\"name\": \"%s\", \"unit\": \"%s\", \"iterations\": %d, \"median\": %.4f, "
+	    "\"mean\": %.4f, \"min\": %.4f, \"p99\": %.4f", r->name, r->unit, r->n, r->median, r->mean, r->min, r->p99);
+    if(r->extra_name)
+      fprintf(f, ", \"%s\": %.4f", r->extra_name, r->extra);
+    fprintf(f, "}%s\n", i + 1 < _nresultats ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+  return !fclose(f);
+}
+
+int main(int argc, char ** argv) {
+  const char * sortie = argc > 1 ? argv[1] : "bench.json";
+  int16_t * pcm;
+  Mix_Chunk * morceau = NULL;
+  Uint16 format = 0;
+  int rate = 0, canaux = 0;
+  /* contexte GL caché (sans écran si besoin) et audio muet */
+  olPrepareEnv();
+  if(!gl4duwCreateWindow(argc, argv, "light_n_tex bench", 0, 0, 256, 256, GL4DW_HIDDEN))
+    return 1;
+  wkInit(0);
+  /* analyse : signal synthétique puis morceau réel décodé */
+  if((pcm = synthetique(DUREE_SIGNAL * FREQUENCE))) {
+    benchAnalyse("synthetic", pcm, DUREE_SIGNAL * FREQUENCE);
+    free(pcm);
+  }
+  /* le morceau est décodé au format du périphérique, qui doit être le nôtre */
+  if(Mix_OpenAudio(FREQUENCE, AUDIO_S16SYS, 2, 1024) == 0 && Mix_QuerySpec(&rate, &format, &canaux) &&
+     rate == FREQUENCE && format == AUDIO_S16SYS && canaux == 2 &&
+     (morceau = Mix_LoadWAV("audio/noisestorm_crab.mp3"))) {
+    int frames = morceau->alen / 4;
+    if(frames > DUREE_SIGNAL * FREQUENCE)
+      frames = DUREE_SIGNAL * FREQUENCE;
+    benchAnalyse("recorded", (const int16_t *)morceau->abuf, frames);
+    Mix_FreeChunk(morceau);
+  } else
+    fprintf(stderr, "analyse/recorded : morceau indisponible (%s)\n", Mix_GetError());
+  Mix_CloseAudio();
+  /* textures, soumission par frame (mêmes matrices que window.cpp), scène complète */
+  benchTexture("images/wood_maps/wood_color.png");
+  gl4duGenMatrix(GL_FLOAT, "model");
+  gl4duGenMatrix(GL_FLOAT, "view");
+  gl4duGenMatrix(GL_FLOAT, "proj");
+  benchSoumission(3);
+  benchSoumission(64);
+  benchSoumission(4096);
+  benchScene("800x800");
+  benchScene("1920x1080");
+  txQuit();
+  wkQuit();
+  if(!ecrire(sortie)) {
+    fprintf(stderr, "impossible d'ecrire %s\n", sortie);
+    return 2;
+  }
+  fprintf(stderr, "%d resultats ecrits dans %s\n", _nresultats, sortie);
+  gl4duClean(GL4DU_ALL);
+  return 0;
+}
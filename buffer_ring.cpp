@@ -0,0 +1,84 @@
+/*!\file buffer_ring.cpp
+ *
+ * \brief buffer persistant découpé en régions tournantes. Voir
+ * buffer_ring.h.
+ */
+#include "buffer_ring.h"
+#include <string.h>
+
+/* GL 4.4 ou extension ARB_buffer_storage */
+int brHasBufferStorage(void) {
+  GLint major = 0, minor = 0, n = 0, i;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  if(major > 4 || (major == 4 && minor >= 4))
+    return 1;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+  for(i = 0; i < n; ++i)
+    if(!strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_buffer_storage"))
+      return 1;
+  return 0;
+}
+
+int brInit(br_ring_t * ring, GLenum target, GLsizeiptr region_size) {
+  GLsizeiptr total = BR_REGIONS * region_size;
+  memset(ring, 0, sizeof *ring);
+  ring->target = target;
+  ring->region_size = region_size;
+  glGenBuffers(1, &ring->buffer);
+  if(!ring->buffer)
+    return 0;
+  glBindBuffer(target, ring->buffer);
+#ifdef GL_MAP_PERSISTENT_BIT
+  if(brHasBufferStorage()) {
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(target, total, NULL, flags);
+    ring->mapped = (GLubyte *)glMapBufferRange(target, 0, total, flags);
+  }
+#endif
+  /* pas de buffer persistant : stockage ordinaire, un transfert par
+   * frame */
+  if(!ring->mapped)
+    glBufferData(target, total, NULL, GL_STREAM_DRAW);
+  glBindBuffer(target, 0);
+  return 1;
+}
+
+GLubyte * brBegin(br_ring_t * ring) {
+  ring->region = (ring->region + 1) % BR_REGIONS;
+  if(ring->fences[ring->region]) {
+    /* ne bloque que si le GPU a BR_REGIONS frames de retard */
+    glClientWaitSync(ring->fences[ring->region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    glDeleteSync(ring->fences[ring->region]);
+    ring->fences[ring->region] = 0;
+  }
+  return brData(ring);
+}
+
+GLubyte * brData(const br_ring_t * ring) {
+  return ring->mapped ? ring->mapped + ring->region * ring->region_size : NULL;
+}
+
+GLintptr brOffset(const br_ring_t * ring) {
+  return ring->region * ring->region_size;
+}
+
+void brEnd(br_ring_t * ring) {
+  ring->fences[ring->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void brQuit(br_ring_t * ring) {
+  int i;
+  for(i = 0; i < BR_REGIONS; ++i)
+    if(ring->fences[i])
+      glDeleteSync(ring->fences[i]);
+  if(ring->buffer) {
+    if(ring->mapped) {
+      glBindBuffer(ring->target, ring->buffer);
+      glUnmapBuffer(ring->target);
+      glBindBuffer(ring->target, 0);
+    }
+    glDeleteBuffers(1, &ring->buffer);
+  }
+  memset(ring, 0, sizeof *ring);
+}
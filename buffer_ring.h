@@ -0,0 +1,55 @@
+/*!\file buffer_ring.h
+ *
+ * \brief buffer OpenGL persistant (GL 4.4 / ARB_buffer_storage)
+ * découpé en BR_REGIONS régions tournantes protégées par des fences,
+ * pour ne jamais écrire dans une région encore lue par le GPU.
+ * Partagé par les blocs d'uniformes et le PBO du spectre.
+ *
+ * Sans buffer persistant, le buffer est tout de même créé (non
+ * projeté) : à l'appelant de le remplir par glBufferSubData ou de
+ * s'en passer.
+ */
+#ifndef _BUFFER_RING_H
+#define _BUFFER_RING_H
+
+#include <GL4D/gl4dummies.h>
+
+/*!\brief nombre de frames pouvant être en vol côté GPU. */
+#define BR_REGIONS 3
+
+typedef struct br_ring_t br_ring_t;
+struct br_ring_t {
+  /*!\brief buffer et cible à laquelle il est lié pour sa création. */
+  GLuint buffer;
+  GLenum target;
+  /*!\brief taille d'une région et région courante. */
+  GLsizeiptr region_size;
+  int region;
+  /*!\brief fences de chaque région. */
+  GLsync fences[BR_REGIONS];
+  /*!\brief début de la projection persistante, NULL sans. */
+  GLubyte * mapped;
+};
+
+/*!\brief retourne 1 si le contexte a glBufferStorage (GL 4.4 ou
+ * ARB_buffer_storage). */
+extern int       brHasBufferStorage(void);
+/*!\brief créé dans \a ring un buffer de BR_REGIONS régions de \a
+ * region_size octets pour la cible \a target, projeté de façon
+ * persistante si possible. Retourne 0 en cas d'échec. */
+extern int       brInit(br_ring_t * ring, GLenum target, GLsizeiptr region_size);
+/*!\brief passe à la région suivante en attendant (seulement si le GPU
+ * a BR_REGIONS frames de retard) que le GPU ait fini de la lire.
+ * Retourne son début côté CPU, NULL sans projection persistante. */
+extern GLubyte * brBegin(br_ring_t * ring);
+/*!\brief début de la région courante côté CPU, NULL sans projection. */
+extern GLubyte * brData(const br_ring_t * ring);
+/*!\brief décalage de la région courante dans le buffer. */
+extern GLintptr  brOffset(const br_ring_t * ring);
+/*!\brief pose la fence de la région courante, après les commandes qui
+ * la lisent. */
+extern void      brEnd(br_ring_t * ring);
+/*!\brief supprime fences et buffer, remet \a ring à zéro. */
+extern void      brQuit(br_ring_t * ring);
+
+#endif
@@ -0,0 +1,217 @@
+/*!\file clustered_lights.cpp
+ *
+ * \brief rangement des lumières dans les clusters et textures
+ * buffer. Voir clustered_lights.h.
+ *
+ * Chaque tranche de profondeur est rangée indépendamment : d'abord
+ * les lumières qui la touchent, puis celles de chaque rangée de
+ * tuiles, puis celles de chaque cluster (test sphère / boîte
+ * englobante du cluster en coordonnées de vue). Les indices d'une
+ * tranche vont dans son propre segment, les segments sont mis bout à
+ * bout avant le transfert.
+ */
+#include "clustered_lights.h"
+#include "workers.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* indices au plus par tranche (32 par cluster en moyenne), réduits
+ * par clInit à ce que GL_MAX_TEXTURE_BUFFER_SIZE permet ; au-delà les
+ * lumières suivantes sont ignorées dans la tranche. En dessous d'un
+ * indice par cluster, clInit échoue. */
+#define CL_SLICE_INDICES (CL_X * CL_Y * 32)
+#define CL_SLICE_MIN     (CL_X * CL_Y)
+#define CL_CLUSTERS      (CL_X * CL_Y * CL_Z)
+
+static int _max = 0, _n = 0, _total = 0, _slice = CL_SLICE_INDICES;
+static cl_light_t * _lights = NULL;
+/* lumières en coordonnées de vue, 8 flottants chacune (position,
+ * portée, couleur x intensité, 0) : c'est aussi le contenu de la
+ * texture des lumières */
+static GLfloat * _view_lights = NULL;
+/* par tranche : lumières qui la touchent, celles d'une rangée, segment
+ * d'indices et son remplissage */
+static int * _proches = NULL, * _ligne = NULL, _counts[CL_Z];
+static GLushort * _scratch = NULL, * _indices = NULL;
+/* début et nombre d'indices de chaque cluster */
+static GLuint * _grid = NULL;
+/* limites des tranches et facteurs de la projection */
+static GLfloat _zb[CL_Z + 1], _znear = 1.0f, _zfar = 100.0f, _sx = 1.0f, _sy = 1.0f;
+/* buffers et textures buffer : lumières, grille, indices */
+static GLuint _buffers[3] = { 0 }, _textures[3] = { 0 };
+
+int clInit(int max_lights, GLfloat znear, GLfloat zfar) {
+  static const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+  GLsizeiptr sizes[3];
+  GLint texels = 0;
+  int i;
+  clQuit();
+  if(max_lights <= 0 || max_lights > CL_MAX_LIGHTS || znear <= 0.0f || zfar <= znear)
+    return 0;
+  /* GL 3.3 ne garantit que 65536 texels par texture buffer : la
+   * texture des indices (toutes les tranches) doit y tenir */
+  glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+  _slice = texels / CL_Z < CL_SLICE_INDICES ? texels / CL_Z : CL_SLICE_INDICES;
+  if(_slice < CL_SLICE_MIN || texels < max_lights * 2 || texels < CL_CLUSTERS)
+    return 0;
+  sizes[0] = (GLsizeiptr)(max_lights * 8 * sizeof(GLfloat));
+  sizes[1] = (GLsizeiptr)(CL_CLUSTERS * 2 * sizeof(GLuint));
+  sizes[2] = (GLsizeiptr)(CL_Z * _slice * sizeof(GLushort));
+  _lights = (cl_light_t *)calloc(max_lights, sizeof *_lights);
+  _view_lights = (GLfloat *)malloc(max_lights * 8 * sizeof *_view_lights);
+  _proches = (int *)malloc(CL_Z * max_lights * sizeof *_proches);
+  _ligne = (int *)malloc(CL_Z * max_lights * sizeof *_ligne);
+  _scratch = (GLushort *)malloc(CL_Z * _slice * sizeof *_scratch);
+  _indices = (GLushort *)malloc(CL_Z * _slice * sizeof *_indices);
+  _grid = (GLuint *)malloc(CL_CLUSTERS * 2 * sizeof *_grid);
+  if(!_lights || !_view_lights || !_proches || !_ligne || !_scratch || !_indices || !_grid) {
+    clQuit();
+    return 0;
+  }
+  _max = max_lights;
+  _znear = znear;
+  _zfar = zfar;
+  for(i = 0; i <= CL_Z; ++i)
+    _zb[i] = znear * powf(zfar / znear, i / (float)CL_Z);
+  glGenBuffers(3, _buffers);
+  glGenTextures(3, _textures);
+  for(i = 0; i < 3; ++i) {
+    glBindBuffer(GL_TEXTURE_BUFFER, _buffers[i]);
+    glBufferData(GL_TEXTURE_BUFFER, sizes[i], NULL, GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, _textures[i]);
+    glTexBuffer(GL_TEXTURE_BUFFER, formats[i], _buffers[i]);
+  }
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  return 1;
+}
+
+cl_light_t * clLight(int i) {
+  return &_lights[i];
+}
+
+/* range les tranches [begin, end) */
+static void ranger(void * arg, int begin, int end) {
+  int z;
+  (void)arg;
+  for(z = begin; z < end; ++z) {
+    const GLfloat zn = _zb[z], zf = _zb[z + 1];
+    int * proches = _proches + z * _max, * ligne = _ligne + z * _max;
+    GLushort * out = _scratch + z * _slice;
+    GLuint * g = _grid + 2 * z * CL_X * CL_Y;
+    int m = 0, used = 0, x, y, j;
+    for(j = 0; j < _n; ++j) {
+      const GLfloat * l = _view_lights + 8 * j, d = -l[2];
+      if(d + l[3] >= zn && d - l[3] <= zf)
+	proches[m++] = j;
+    }
+    for(y = 0; y < CL_Y; ++y) {
+      /* bornes en y de la rangée aux deux profondeurs de la tranche */
+      const GLfloat y0 = -1.0f + 2.0f * y / CL_Y, y1 = y0 + 2.0f / CL_Y;
+      const GLfloat ymin = fminf(y0 * zn, y0 * zf) / _sy, ymax = fmaxf(y1 * zn, y1 * zf) / _sy;
+      int mr = 0;
+      for(j = 0; j < m; ++j) {
+	const GLfloat * l = _view_lights + 8 * proches[j];
+	if(l[1] + l[3] >= ymin && l[1] - l[3] <= ymax)
+	  ligne[mr++] = proches[j];
+      }
+      for(x = 0; x < CL_X; ++x) {
+	const GLfloat x0 = -1.0f + 2.0f * x / CL_X, x1 = x0 + 2.0f / CL_X;
+	const GLfloat xmin = fminf(x0 * zn, x0 * zf) / _sx, xmax = fmaxf(x1 * zn, x1 * zf) / _sx;
+	int off = used;
+	for(j = 0; j < mr; ++j) {
+	  const GLfloat * l = _view_lights + 8 * ligne[j];
+	  /* distance de la lumière à la boîte du cluster */
+	  GLfloat dx = l[0] < xmin ? xmin - l[0] : (l[0] > xmax ? l[0] - xmax : 0.0f);
+	  GLfloat dy = l[1] < ymin ? ymin - l[1] : (l[1] > ymax ? l[1] - ymax : 0.0f);
+	  GLfloat dz = l[2] < -zf ? -zf - l[2] : (l[2] > -zn ? l[2] + zn : 0.0f);
+	  if(dx * dx + dy * dy + dz * dz <= l[3] * l[3] && used < _slice)
+	    out[used++] = (GLushort)ligne[j];
+	}
+	g[2 * (y * CL_X + x)] = off;
+	g[2 * (y * CL_X + x) + 1] = used - off;
+      }
+    }
+    _counts[z] = used;
+  }
+}
+
+void clUpdate(int n, const GLfloat * view, const GLfloat * proj, int width, int height,
+	      GLfloat * scale, GLint * dims) {
+  int i, z, k;
+  _n = n < 0 ? 0 : (n > _max ? _max : n);
+  _sx = proj[0];
+  _sy = proj[5];
+  /* en coordonnées de vue, couleur prémultipliée par l'intensité */
+  for(i = 0; i < _n; ++i) {
+    const cl_light_t * l = &_lights[i];
+    GLfloat * v = _view_lights + 8 * i;
+    for(k = 0; k < 3; ++k) {
+      v[k] = view[4 * k] * l->position[0] + view[4 * k + 1] * l->position[1] +
+	view[4 * k + 2] * l->position[2] + view[4 * k + 3];
+      v[4 + k] = l->color[k] * l->intensity;
+    }
+    v[3] = l->radius;
+    v[7] = 0.0f;
+  }
+  /* une tranche par tâche */
+  wkParallelFor(CL_Z, 1, ranger, NULL);
+  /* segments bout à bout, débuts des clusters décalés d'autant */
+  for(z = 0, _total = 0; z < CL_Z; ++z) {
+    GLuint * g = _grid + 2 * z * CL_X * CL_Y;
+    memcpy(_indices + _total, _scratch + z * _slice, _counts[z] * sizeof *_indices);
+    for(k = 0; k < CL_X * CL_Y; ++k)
+      g[2 * k] += _total;
+    _total += _counts[z];
+  }
+  /* transferts (les buffers sont abandonnés au pilote avant d'être
+   * réécrits, sans attendre le GPU) puis liaison des textures */
+  glBindBuffer(GL_TEXTURE_BUFFER, _buffers[0]);
+  glBufferData(GL_TEXTURE_BUFFER, _max * 8 * sizeof *_view_lights, NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_TEXTURE_BUFFER, 0, _n * 8 * sizeof *_view_lights, _view_lights);
+  glBindBuffer(GL_TEXTURE_BUFFER, _buffers[1]);
+  glBufferData(GL_TEXTURE_BUFFER, CL_CLUSTERS * 2 * sizeof *_grid, _grid, GL_STREAM_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, _buffers[2]);
+  glBufferData(GL_TEXTURE_BUFFER, CL_Z * _slice * sizeof *_indices, NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_TEXTURE_BUFFER, 0, _total * sizeof *_indices, _indices);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  for(i = 0; i < 3; ++i) {
+    glActiveTexture(GL_TEXTURE0 + CL_UNIT_LIGHTS + i);
+    glBindTexture(GL_TEXTURE_BUFFER, _textures[i]);
+  }
+  glActiveTexture(GL_TEXTURE0);
+  /* tranche = log(profondeur) x scale[2] + scale[3] */
+  scale[0] = CL_X / (GLfloat)width;
+  scale[1] = CL_Y / (GLfloat)height;
+  scale[2] = CL_Z / logf(_zfar / _znear);
+  scale[3] = -scale[2] * logf(_znear);
+  dims[0] = CL_X;
+  dims[1] = CL_Y;
+  dims[2] = CL_Z;
+  dims[3] = _n;
+}
+
+int clIndices(void) {
+  return _total;
+}
+
+void clQuit(void) {
+  if(_textures[0]) {
+    glDeleteTextures(3, _textures);
+    memset(_textures, 0, sizeof _textures);
+  }
+  if(_buffers[0]) {
+    glDeleteBuffers(3, _buffers);
+    memset(_buffers, 0, sizeof _buffers);
+  }
+  free(_lights); free(_view_lights);
+  free(_proches); free(_ligne);
+  free(_scratch); free(_indices); free(_grid);
+  _lights = NULL;
+  _view_lights = NULL;
+  _proches = _ligne = NULL;
+  _scratch = _indices = NULL;
+  _grid = NULL;
+  _max = _n = _total = 0;
+}
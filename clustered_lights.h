@@ -0,0 +1,69 @@
+/*!\file clustered_lights.h
+ *
+ * \brief éclairage "clustered forward" : des centaines de lumières
+ * ponctuelles, chaque fragment n'évaluant que celles de son cluster.
+ *
+ * Le volume de vue est découpé en CL_X x CL_Y tuiles d'écran et CL_Z
+ * tranches de profondeur (logarithmiques entre near et far). À chaque
+ * frame, les lumières (en coordonnées monde, remplies par l'appelant)
+ * sont passées en coordonnées de vue puis rangées dans les clusters
+ * qu'elles touchent, une tranche par tâche sur le pool de threads
+ * (workers.h). Trois textures buffer (TBO) portent le résultat vers
+ * la variante SV_CLUSTERED de light_n_tex.fs :
+ * - les lumières, deux texels RGBA32F chacune (position de vue et
+ *   portée, couleur x intensité) ;
+ * - la grille, un texel RG32UI par cluster (début et nombre d'indices) ;
+ * - la liste des indices de lumières, R16UI.
+ */
+#ifndef _CLUSTERED_LIGHTS_H
+#define _CLUSTERED_LIGHTS_H
+
+#include <GL4D/gl4dummies.h>
+
+/*!\brief découpage du volume de vue. */
+#define CL_X 16
+#define CL_Y 16
+#define CL_Z 24
+/*!\brief nombre maximal de lumières. */
+#define CL_MAX_LIGHTS 1024
+/*!\brief unités de texture des samplers cl_lights, cl_grid et
+ * cl_indices des shaders. */
+#define CL_UNIT_LIGHTS  3
+#define CL_UNIT_GRID    4
+#define CL_UNIT_INDICES 5
+
+/*!\brief une lumière ponctuelle, en coordonnées monde ; son effet
+ * s'annule à la distance \a radius. */
+typedef struct cl_light_t cl_light_t;
+struct cl_light_t {
+  GLfloat position[3];
+  GLfloat radius;
+  GLfloat color[3];
+  GLfloat intensity;
+};
+
+/*!\brief réserve \a max_lights lumières (au plus CL_MAX_LIGHTS) et
+ * les textures ; les tranches couvrent les profondeurs de \a znear à
+ * \a zfar (au-delà, la dernière tranche). Les indices par tranche
+ * sont limités par GL_MAX_TEXTURE_BUFFER_SIZE. Retourne 0 en cas
+ * d'échec, y compris si les textures buffer du pilote sont trop
+ * petites. */
+extern int          clInit(int max_lights, GLfloat znear, GLfloat zfar);
+/*!\brief retourne la lumière \a i, à remplir avant clUpdate. */
+extern cl_light_t * clLight(int i);
+/*!\brief range les \a n premières lumières dans les clusters pour la
+ * vue \a view et la projection en perspective symétrique \a proj (par
+ * lignes comme les matrices GL4D) d'une image de \a width x \a height
+ * pixels, transfère le résultat et lie les textures à leurs unités.
+ * Remplit \a scale (inverse de la taille d'une tuile en pixels,
+ * facteur et décalage de log(profondeur) vers la tranche) et \a dims
+ * (CL_X, CL_Y, CL_Z, \a n) pour le bloc d'éclairage. */
+extern void         clUpdate(int n, const GLfloat * view, const GLfloat * proj, int width, int height,
+			     GLfloat * scale, GLint * dims);
+/*!\brief nombre d'indices rangés à la dernière mise à jour (lumières
+ * comptées une fois par cluster touché). */
+extern int          clIndices(void);
+/*!\brief libère tout. */
+extern void         clQuit(void);
+
+#endif
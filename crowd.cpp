@@ -0,0 +1,149 @@
+/*!\file crowd.cpp
+ *
+ * \brief foule d'instances réactives au son. Voir crowd.h.
+ */
+#include "crowd.h"
+#include "meshes.h"
+#include "uniform_blocks.h"
+#include <stdlib.h>
+#include <math.h>
+
+#ifndef M_PI
+#  define M_PI 3.14159265358979323846
+#endif
+
+/* anneau du sol occupé par la foule (le centre est laissé à la scène) */
+#define CR_RMIN  4.0f
+#define CR_RMAX 14.0f
+
+/* une instance telle que lue par le vertex shader : matrice de
+ * modélisation par colonnes puis couleur */
+typedef struct { GLfloat model[16], color[4]; } cr_instance_t;
+
+static int _n = 0;
+static ms_mesh_t _meshes[CR_PRIMITIVES];
+static GLuint _instances = 0;
+/* placement fixe de chaque instance (SoA) : position au sol, phase
+ * de rotation, taille de base et bande suivie ; teinte de chaque bande */
+static float * _x = NULL, * _z = NULL, * _phase = NULL, * _base = NULL;
+static int * _band = NULL;
+static float _hue[AA_MAX_BANDS][3];
+
+static float clamp01(float x) {
+  return x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x);
+}
+
+/* teinte saturée pour h dans [0, 1] */
+static void hue(float h, float * rgb) {
+  rgb[0] = clamp01(fabsf(h * 6.0f - 3.0f) - 1.0f);
+  rgb[1] = clamp01(2.0f - fabsf(h * 6.0f - 2.0f));
+  rgb[2] = clamp01(2.0f - fabsf(h * 6.0f - 4.0f));
+}
+
+int crInit(int n) {
+  int i, k, total = CR_PRIMITIVES * n;
+  float spacing;
+  if(n <= 0)
+    return 0;
+  _x = (float *)malloc(total * sizeof *_x);
+  _z = (float *)malloc(total * sizeof *_z);
+  _phase = (float *)malloc(total * sizeof *_phase);
+  _base = (float *)malloc(total * sizeof *_base);
+  _band = (int *)malloc(total * sizeof *_band);
+  if(!_x || !_z || !_phase || !_base || !_band) {
+    crQuit();
+    return 0;
+  }
+  _n = n;
+  /* spirale de Vogel sur l'anneau : densité uniforme, sans motif de grille */
+  spacing = sqrtf((float)M_PI * (CR_RMAX * CR_RMAX - CR_RMIN * CR_RMIN) / total);
+  for(i = 0; i < total; ++i) {
+    float r = sqrtf(CR_RMIN * CR_RMIN + (CR_RMAX * CR_RMAX - CR_RMIN * CR_RMIN) * (i + 0.5f) / total);
+    float theta = 2.39996323f * i;
+    /* l'instance i est la (i / 3)e de la primitive i % 3 : on range par primitive */
+    int j = (i % CR_PRIMITIVES) * n + i / CR_PRIMITIVES;
+    _x[j] = r * cosf(theta);
+    _z[j] = r * sinf(theta);
+    _phase[j] = theta;
+    _base[j] = 0.35f * spacing;
+    /* les graves au centre, les aigus au bord */
+    _band[j] = (int)((r - CR_RMIN) / (CR_RMAX - CR_RMIN) * AA_MAX_BANDS);
+    if(_band[j] >= AA_MAX_BANDS) _band[j] = AA_MAX_BANDS - 1;
+  }
+  for(k = 0; k < AA_MAX_BANDS; ++k)
+    hue(0.7f * k / AA_MAX_BANDS, _hue[k]);
+  /* mêmes primitives que la scène, dans le même ordre */
+  if(!msGenCone(&_meshes[0], 8, 1) || !msGenQuad(&_meshes[1]) || !msGenSphere(&_meshes[2], 8, 6)) {
+    crQuit();
+    return 0;
+  }
+  glGenBuffers(1, &_instances);
+  glBindBuffer(GL_ARRAY_BUFFER, _instances);
+  glBufferData(GL_ARRAY_BUFFER, total * sizeof(cr_instance_t), NULL, GL_STREAM_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  for(k = 0; k < CR_PRIMITIVES; ++k)
+    msAttachInstances(&_meshes[k], _instances, k * n * sizeof(cr_instance_t), sizeof(cr_instance_t));
+  return 1;
+}
+
+void crUpdate(const aa_features_t * smooth, const aa_features_t * peak, float a) {
+  int i, total = CR_PRIMITIVES * _n, nb = smooth->nbands > 0 ? smooth->nbands : 1;
+  cr_instance_t * inst;
+  if(!_n)
+    return;
+  glBindBuffer(GL_ARRAY_BUFFER, _instances);
+  /* invalider le buffer : le pilote en fournit un neuf sans attendre
+   * que le GPU ait fini de lire celui de la frame précédente */
+  inst = (cr_instance_t *)glMapBufferRange(GL_ARRAY_BUFFER, 0, total * sizeof *inst,
+					   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if(!inst) {
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return;
+  }
+  for(i = 0; i < total; ++i) {
+    /* ramener la bande de placement au nombre de bandes analysées */
+    int b = _band[i] * nb / AA_MAX_BANDS;
+    float e = peak->bands[b], es = smooth->bands[b];
+    float s = _base[i] * (0.4f + 1.6f * e);
+    float ang = _phase[i] + a * 0.02f * (1.0f + es);
+    float c = cosf(ang) * s, sn = sinf(ang) * s;
+    GLfloat * m = inst[i].model;
+    /* T(x, y, z) * Ry(ang) * S(s), rangée par colonnes */
+    m[0] = c;    m[1] = 0.0f; m[2]  = -sn;  m[3]  = 0.0f;
+    m[4] = 0.0f; m[5] = s;    m[6]  = 0.0f; m[7]  = 0.0f;
+    m[8] = sn;   m[9] = 0.0f; m[10] = c;    m[11] = 0.0f;
+    m[12] = _x[i]; m[13] = s + 1.5f * e * e; m[14] = _z[i]; m[15] = 1.0f;
+    inst[i].color[0] = _hue[_band[i]][0] * (0.3f + 0.7f * e);
+    inst[i].color[1] = _hue[_band[i]][1] * (0.3f + 0.7f * e);
+    inst[i].color[2] = _hue[_band[i]][2] * (0.3f + 0.7f * e);
+    inst[i].color[3] = 1.0f;
+  }
+  glUnmapBuffer(GL_ARRAY_BUFFER);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void crDraw(int first_material) {
+  int k;
+  for(k = 0; k < CR_PRIMITIVES; ++k) {
+    ubUseMaterial(first_material + k);
+    msDrawInstanced(&_meshes[k], _n);
+  }
+}
+
+int crCount(void) {
+  return _n;
+}
+
+void crQuit(void) {
+  int k;
+  for(k = 0; k < CR_PRIMITIVES; ++k)
+    msDelete(&_meshes[k]);
+  if(_instances) {
+    glDeleteBuffers(1, &_instances);
+    _instances = 0;
+  }
+  free(_x); free(_z); free(_phase); free(_base); free(_band);
+  _x = _z = _phase = _base = NULL;
+  _band = NULL;
+  _n = 0;
+}
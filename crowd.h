@@ -0,0 +1,32 @@
+/*!\file crowd.h
+ *
+ * \brief mode « foule de crabes » : des milliers d'instances de
+ * chaque primitive (cône, quadrilatère, sphère) réparties sur le sol
+ * et animées par le spectre, dessinées en un appel instancié par
+ * primitive. Les transformations et couleurs d'instance sont
+ * réécrites à chaque frame dans un unique buffer d'instances.
+ */
+#ifndef _CROWD_H
+#define _CROWD_H
+
+#include "audio_analysis.h"
+
+/*!\brief nombre de primitives différentes de la foule. */
+#define CR_PRIMITIVES 3
+
+/*!\brief créé la foule de \a n instances par primitive. Retourne 0 en
+ * cas d'échec. */
+extern int  crInit(int n);
+/*!\brief recalcule les instances à partir des caractéristiques
+ * lissées \a smooth et maintenues \a peak, et de l'angle d'animation
+ * \a a. */
+extern void crUpdate(const aa_features_t * smooth, const aa_features_t * peak, float a);
+/*!\brief dessine la foule, la primitive k utilisant le matériau
+ * \a first_material + k des blocs d'uniformes. */
+extern void crDraw(int first_material);
+/*!\brief nombre d'instances par primitive. */
+extern int  crCount(void);
+/*!\brief libère la foule. */
+extern void crQuit(void);
+
+#endif
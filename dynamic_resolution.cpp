@@ -0,0 +1,165 @@
+/*!\file dynamic_resolution.cpp
+ *
+ * \brief framebuffer à résolution variable et son
+ * contrôleur. Voir dynamic_resolution.h.
+ */
+#include "dynamic_resolution.h"
+#include <math.h>
+
+/* requêtes en vol : relues avec deux ou trois frames de retard */
+#define DR_QUERIES 4
+/* frames sans changement d'échelle après un changement */
+#define DR_PAUSE   8
+/* marges : descendre au-dessus du budget, remonter sous 70% */
+#define DR_VISEE   0.9
+#define DR_MARGE   0.7
+#define DR_PAS     0.05
+
+static GLuint _fbo = 0, _rbo[2] = { 0 };
+static GLuint _queries[DR_QUERIES] = { 0 };
+/* requêtes lancées non relues : de _premiere à _prochaine (exclue) */
+static int _premiere = 0, _prochaine = 0, _pause = 0, _mesure = 0;
+static int _w = 0, _h = 0, _rw = 0, _rh = 0;
+static double _budget = 16.0, _min = 0.5, _scale = 1.0, _gpu = 0.0;
+/* destination rétablie par drEnd */
+static GLint _dest = 0, _vp[4];
+
+/* (ré)alloue couleur et profondeur en \a w x \a h ; le framebuffer
+ * garde ses attachements. Retourne 0 s'il est incomplet. */
+static int allouer(int w, int h) {
+  int ok;
+  glBindRenderbuffer(GL_RENDERBUFFER, _rbo[0]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+  glBindRenderbuffer(GL_RENDERBUFFER, _rbo[1]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+  ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if(ok) {
+    _w = w;
+    _h = h;
+  }
+  return ok;
+}
+
+int drInit(int w, int h, double budget_ms, double min_scale) {
+  drQuit();
+  if(w < 1 || h < 1 || budget_ms <= 0.0)
+    return 0;
+  glGenRenderbuffers(2, _rbo);
+  glGenFramebuffers(1, &_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _rbo[0]);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _rbo[1]);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if(!allouer(w, h)) {
+    drQuit();
+    return 0;
+  }
+  glGenQueries(DR_QUERIES, _queries);
+  _budget = budget_ms;
+  _min = min_scale > 0.1 ? (min_scale < 1.0 ? min_scale : 1.0) : 0.1;
+  _scale = 1.0;
+  _gpu = 0.0;
+  _premiere = _prochaine = _pause = 0;
+  return 1;
+}
+
+/* relit sans attendre les requêtes terminées, dans l'ordre */
+static void relire(void) {
+  while(_premiere != _prochaine) {
+    GLuint q = _queries[_premiere % DR_QUERIES], dispo = 0;
+    GLuint64 ns = 0;
+    glGetQueryObjectuiv(q, GL_QUERY_RESULT_AVAILABLE, &dispo);
+    if(!dispo)
+      break;
+    glGetQueryObjectui64v(q, GL_QUERY_RESULT, &ns);
+    _gpu = _gpu > 0.0 ? _gpu + 0.2 * (ns / 1e6 - _gpu) : ns / 1e6;
+    ++_premiere;
+  }
+}
+
+/* ajuste l'échelle d'après le temps GPU lissé */
+static void ajuster(void) {
+  if(_gpu <= 0.0)
+    return;
+  if(_pause > 0) {
+    --_pause;
+    return;
+  }
+  if(_gpu > _budget && _scale > _min) {
+    /* le coût suit la surface : échelle x racine du rapport */
+    _scale *= sqrt(DR_VISEE * _budget / _gpu);
+    if(_scale < _min) _scale = _min;
+    _pause = DR_PAUSE;
+  } else if(_gpu < DR_MARGE * _budget && _scale < 1.0) {
+    _scale += DR_PAS;
+    if(_scale > 1.0) _scale = 1.0;
+    _pause = DR_PAUSE;
+  }
+}
+
+void drBegin(void) {
+  relire();
+  ajuster();
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &_dest);
+  glGetIntegerv(GL_VIEWPORT, _vp);
+  /* fenêtre agrandie ou surface HiDPI : le framebuffer suit la plus
+   * grande taille demandée (à défaut, l'ancienne taille reste et
+   * l'image est bornée) */
+  if(_vp[2] > _w || _vp[3] > _h) {
+    int w = _vp[2] > _w ? _vp[2] : _w, h = _vp[3] > _h ? _vp[3] : _h, w0 = _w, h0 = _h;
+    if(!allouer(w, h))
+      allouer(w0, h0);
+  }
+  _rw = (int)(_vp[2] * _scale + 0.5);
+  _rh = (int)(_vp[3] * _scale + 0.5);
+  if(_rw > _w) _rw = _w;
+  if(_rh > _h) _rh = _h;
+  if(_rw < 1) _rw = 1;
+  if(_rh < 1) _rh = 1;
+  glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+  glViewport(0, 0, _rw, _rh);
+  /* toutes les requêtes en vol : pas de mesure pour cette frame */
+  _mesure = _prochaine - _premiere < DR_QUERIES;
+  if(_mesure)
+    glBeginQuery(GL_TIME_ELAPSED, _queries[_prochaine % DR_QUERIES]);
+}
+
+void drEnd(void) {
+  if(_mesure) {
+    glEndQuery(GL_TIME_ELAPSED);
+    ++_prochaine;
+  }
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _dest);
+  glBlitFramebuffer(0, 0, _rw, _rh, _vp[0], _vp[1], _vp[0] + _vp[2], _vp[1] + _vp[3],
+		    GL_COLOR_BUFFER_BIT, _rw == _vp[2] && _rh == _vp[3] ? GL_NEAREST : GL_LINEAR);
+  glBindFramebuffer(GL_FRAMEBUFFER, _dest);
+  glViewport(_vp[0], _vp[1], _vp[2], _vp[3]);
+}
+
+double drScale(void) {
+  return _scale;
+}
+
+double drGpuTime(void) {
+  return _gpu;
+}
+
+void drQuit(void) {
+  if(_queries[0]) {
+    glDeleteQueries(DR_QUERIES, _queries);
+    _queries[0] = 0;
+  }
+  if(_fbo) {
+    glDeleteFramebuffers(1, &_fbo);
+    _fbo = 0;
+  }
+  if(_rbo[0]) {
+    glDeleteRenderbuffers(2, _rbo);
+    _rbo[0] = _rbo[1] = 0;
+  }
+  _w = _h = 0;
+}
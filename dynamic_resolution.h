@@ -0,0 +1,41 @@
+/*!\file dynamic_resolution.h
+ *
+ * \brief résolution dynamique : la scène est dessinée dans un
+ * framebuffer hors écran à une fraction de la taille de l'image,
+ * fraction ajustée pour tenir un budget de temps GPU par frame, puis
+ * agrandie (glBlitFramebuffer, filtrage linéaire) vers le framebuffer
+ * de destination.
+ *
+ * Le temps GPU est mesuré par des requêtes GL_TIME_ELAPSED tournantes,
+ * relues sans attente quelques frames plus tard. L'échelle (par côté)
+ * descend d'un coup à la valeur qui tiendrait le budget (le coût
+ * suit la surface) et remonte par petits pas quand il reste de la
+ * marge ; une pause de quelques frames suit chaque changement, le
+ * temps que les mesures le reflètent.
+ */
+#ifndef _DYNAMIC_RESOLUTION_H
+#define _DYNAMIC_RESOLUTION_H
+
+#include <GL4D/gl4dummies.h>
+
+/*!\brief créé le framebuffer de \a w x \a h pixels (agrandi par
+ * drBegin si le viewport le dépasse, après un redimensionnement ou
+ * sur un écran HiDPI) et vise \a
+ * budget_ms millisecondes de GPU par frame, sans descendre sous
+ * l'échelle \a min_scale (par côté). Retourne 0 en cas d'échec. */
+extern int    drInit(int w, int h, double budget_ms, double min_scale);
+/*!\brief relit les mesures disponibles, ajuste l'échelle, dirige le
+ * dessin vers le framebuffer hors écran (viewport à l'échelle) et
+ * commence la mesure de la frame. */
+extern void   drBegin(void);
+/*!\brief termine la mesure et agrandit l'image vers le framebuffer et
+ * le viewport actifs à l'appel de drBegin, qui sont rétablis. */
+extern void   drEnd(void);
+/*!\brief échelle courante (par côté, dans [min_scale, 1]). */
+extern double drScale(void);
+/*!\brief temps GPU lissé d'une frame, en millisecondes. */
+extern double drGpuTime(void);
+/*!\brief libère le framebuffer et les requêtes. */
+extern void   drQuit(void);
+
+#endif
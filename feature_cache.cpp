@@ -0,0 +1,364 @@
+/*!\file feature_cache.cpp
+ *
+ * \brief pré-analyse hors ligne et cache de caractéristiques projeté
+ * en mémoire. Voir feature_cache.h.
+ *
+ * Format du fichier (boutisme natif) : un fc_header_t, puis nframes
+ * fc_record_t, nframes x nbands octets de bandes quantifiées, nonsets
+ * indices de pas (uint32) des attaques et nbeats instants (float,
+ * secondes) de la grille de temps.
+ */
+#include "feature_cache.h"
+#include "mapped_file.h"
+#include <SDL.h>
+#include <SDL_mixer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define FC_MAGIC   "SGFEAT\0"
+#define FC_VERSION 1
+/* bornes de recherche du tempo, en battements par minute */
+#define FC_BPM_MIN  60.0
+#define FC_BPM_MAX 180.0
+
+typedef struct fc_header_t fc_header_t;
+struct fc_header_t {
+  char     magic[8];
+  uint32_t version, header_size;
+  uint64_t hash;
+  uint32_t rate, fft_size, nbands, hop;
+  uint32_t nframes, nonsets, nbeats;
+  float    tempo;
+  uint32_t frames_off, bands_off, onsets_off, beats_off;
+  uint32_t total_size, _pad;
+};
+
+typedef struct fc_record_t fc_record_t;
+struct fc_record_t {
+  float level, rms[2], peak, flux;
+};
+
+struct fc_cache_t {
+  /* paramètres de la demande */
+  char * filename;
+  const int16_t * pcm;
+  int frames, channels, rate;
+  int fft_size, nbands, hop;
+  SDL_Thread * thread;
+  SDL_atomic_t status;
+  /* données : projection du fichier de cache ou, à défaut, bloc en RAM */
+  mf_file_t mf;
+  void * blob;
+  const fc_header_t * hdr;
+  const fc_record_t * rec;
+  const uint8_t * bands;
+  const uint32_t * onsets;
+  const float * beats;
+};
+
+static uint32_t align4(uint32_t x) {
+  return (x + 3u) & ~3u;
+}
+
+/* attaques : flux au-dessus de 1.5 fois la moyenne locale (+/- 8 pas),
+ * maximum local et au moins 50ms après l'attaque précédente */
+static uint32_t pickOnsets(const float * flux, uint32_t n, double fps, uint32_t * out) {
+  const int w = 8;
+  uint32_t i, count = 0, gap = (uint32_t)ceil(0.05 * fps), last = 0;
+  for(i = 1; i + 1 < n; ++i) {
+    int j, lo = (int)i - w, hi = (int)i + w, m = 0;
+    float mean = 0.0f;
+    for(j = lo < 0 ? 0 : lo; j <= hi && j < (int)n; ++j, ++m)
+      mean += flux[j];
+    mean /= m;
+    if(flux[i] > 1.5f * mean + 0.01f && flux[i] >= flux[i - 1] && flux[i] >= flux[i + 1] &&
+       (count == 0 || i - last >= gap))
+      out[count++] = last = i;
+  }
+  return count;
+}
+
+/* tempo par autocorrélation du flux, pondérée autour de 120bpm pour
+ * limiter les erreurs d'octave, puis phase maximisant l'énergie sur
+ * la grille. Retourne la période en pas (0 si indéterminée). */
+static double beatGrid(const float * flux, uint32_t n, double fps, double * phase) {
+  int lmin = (int)floor(fps * 60.0 / FC_BPM_MAX), lmax = (int)ceil(fps * 60.0 / FC_BPM_MIN), l, best = 0;
+  double bestv = 0.0, period, bests = -1.0, acs[3] = { 0.0, 0.0, 0.0 };
+  uint32_t i;
+  if(lmin < 1) lmin = 1;
+  if((uint32_t)lmax * 2 >= n)
+    return 0.0;
+  for(l = lmin; l <= lmax; ++l) {
+    double ac = 0.0, bpm = 60.0 * fps / l, wgt = log2(bpm / 120.0);
+    for(i = l; i < n; ++i)
+      ac += flux[i] * flux[i - l];
+    ac *= exp(-0.5 * wgt * wgt);
+    if(ac > bestv) { bestv = ac; best = l; }
+  }
+  if(!best)
+    return 0.0;
+  /* affinage parabolique de la période autour du meilleur décalage */
+  for(l = -1; l <= 1; ++l) {
+    int ll = best + l;
+    for(i = ll; i < n; ++i)
+      acs[l + 1] += flux[i] * flux[i - ll];
+  }
+  period = best;
+  if(acs[0] - 2.0 * acs[1] + acs[2] < 0.0)
+    period += 0.5 * (acs[0] - acs[2]) / (acs[0] - 2.0 * acs[1] + acs[2]);
+  for(l = 0; l < best; ++l) {
+    double s = 0.0, k;
+    for(k = l; k < n; k += period)
+      s += flux[(uint32_t)k];
+    if(s > bests) { bests = s; *phase = l; }
+  }
+  return period;
+}
+
+/* analyse complète du PCM ; retourne un bloc au format du fichier */
+static void * build(const int16_t * pcm, int frames, int channels, int rate,
+		    int fft_size, int nbands, int hop, uint64_t hash, uint32_t * size) {
+  aa_analyzer_t * aa = aaNew(fft_size, nbands, rate);
+  uint32_t n = (uint32_t)((frames + hop - 1) / hop), i, nonsets, nbeats = 0, off;
+  float * flux = (float *)malloc(n * sizeof *flux);
+  uint32_t * onsets = (uint32_t *)malloc(n * sizeof *onsets);
+  double fps = rate / (double)hop, period, phase = 0.0, k;
+  fc_header_t h;
+  char * blob = NULL;
+  fc_record_t * rec;
+  uint8_t * bands;
+  aa_features_t f;
+  if(!aa || !flux || !onsets || n == 0)
+    goto done;
+  memset(&h, 0, sizeof h);
+  memcpy(h.magic, FC_MAGIC, sizeof h.magic);
+  h.version = FC_VERSION;
+  h.header_size = sizeof h;
+  h.hash = hash;
+  h.rate = rate; h.fft_size = fft_size; h.nbands = nbands; h.hop = hop;
+  h.nframes = n;
+  h.frames_off = align4(sizeof h);
+  h.bands_off = h.frames_off + n * sizeof(fc_record_t);
+  h.onsets_off = align4(h.bands_off + n * nbands);
+  /* la place des attaques et des beats est bornée par n */
+  if(!(blob = (char *)calloc(1, h.onsets_off + 2 * n * sizeof(uint32_t))))
+    goto done;
+  rec = (fc_record_t *)(blob + h.frames_off);
+  bands = (uint8_t *)(blob + h.bands_off);
+  for(i = 0; i < n; ++i) {
+    int len = frames - (int)i * hop < hop ? frames - (int)i * hop : hop, b;
+    aaProcessS16(aa, pcm + (size_t)i * hop * channels, len, channels, &f);
+    rec[i].level = f.level;
+    rec[i].rms[0] = f.rms[0];
+    rec[i].rms[1] = f.rms[1];
+    rec[i].peak = f.peak;
+    rec[i].flux = flux[i] = f.flux;
+    for(b = 0; b < nbands; ++b)
+      bands[i * nbands + b] = (uint8_t)(f.bands[b] * 255.0f + 0.5f);
+  }
+  nonsets = pickOnsets(flux, n, fps, onsets);
+  memcpy(blob + h.onsets_off, onsets, nonsets * sizeof *onsets);
+  h.nonsets = nonsets;
+  h.beats_off = h.onsets_off + nonsets * sizeof(uint32_t);
+  if((period = beatGrid(flux, n, fps, &phase)) > 0.0) {
+    float * beats = (float *)(blob + h.beats_off);
+    h.tempo = (float)(60.0 * fps / period);
+    /* un pas décrit l'audio entendu jusqu'à sa fin, d'où le + 1 */
+    for(k = phase; k < n; k += period)
+      beats[nbeats++] = (float)((k + 1.0) / fps);
+  }
+  h.nbeats = nbeats;
+  off = h.beats_off + nbeats * sizeof(float);
+  h.total_size = off;
+  memcpy(blob, &h, sizeof h);
+  *size = off;
+ done:
+  free(flux);
+  free(onsets);
+  aaDelete(aa);
+  return blob;
+}
+
+/* vérifie qu'un bloc est un cache valide pour les paramètres de fc */
+static int validate(fc_cache_t * fc, const void * data, size_t size, uint64_t hash) {
+  const fc_header_t * h = (const fc_header_t *)data;
+  if(size < sizeof *h || memcmp(h->magic, FC_MAGIC, sizeof h->magic) || h->version != FC_VERSION ||
+     h->header_size != sizeof *h || h->hash != hash || h->total_size != size ||
+     (int)h->fft_size != fc->fft_size || (int)h->nbands != fc->nbands || (int)h->hop != fc->hop ||
+     h->beats_off + h->nbeats * sizeof(float) > size)
+    return 0;
+  fc->hdr = h;
+  fc->rec = (const fc_record_t *)((const char *)data + h->frames_off);
+  fc->bands = (const uint8_t *)data + h->bands_off;
+  fc->onsets = (const uint32_t *)((const char *)data + h->onsets_off);
+  fc->beats = (const float *)((const char *)data + h->beats_off);
+  return 1;
+}
+
+static int worker(void * arg) {
+  fc_cache_t * fc = (fc_cache_t *)arg;
+  Mix_Chunk * chunk = NULL;
+  const int16_t * pcm = fc->pcm;
+  int frames = fc->frames, channels = fc->channels, rate = fc->rate;
+  uint64_t hash;
+  uint32_t size = 0;
+  char path[256];
+  if(pcm)
+    hash = mfHash(pcm, (size_t)frames * channels * sizeof *pcm, MF_HASH_SEED);
+  else if(!mfHashFile(fc->filename, &hash))
+    goto failed;
+  snprintf(path, sizeof path, FC_CACHE_DIR "/%016llx-%d-%d-%d.feat",
+	   (unsigned long long)hash, fc->fft_size, fc->nbands, fc->hop);
+  /* exécution suivante sur le même morceau : projeter le cache */
+  if(mfOpen(path, &fc->mf)) {
+    if(validate(fc, fc->mf.data, fc->mf.size, hash))
+      goto ready;
+    mfClose(&fc->mf);
+  }
+  /* sinon décoder tout le fichier au format du périphérique */
+  if(!pcm) {
+    Uint16 format;
+    if(!Mix_QuerySpec(&rate, &format, &channels) || (format != AUDIO_S16SYS))
+      goto failed;
+    if(!(chunk = Mix_LoadWAV(fc->filename))) {
+      fprintf(stderr, "Pre-analyse: Mix_LoadWAV: %s\n", Mix_GetError());
+      goto failed;
+    }
+    pcm = (const int16_t *)chunk->abuf;
+    frames = chunk->alen / (2 * channels);
+  }
+  fc->blob = build(pcm, frames, channels, rate, fc->fft_size, fc->nbands, fc->hop, hash, &size);
+  if(chunk)
+    Mix_FreeChunk(chunk);
+  if(!fc->blob)
+    goto failed;
+  /* écrire le cache puis le projeter ; à défaut garder le bloc en RAM */
+  if(mfWriteAtomic(path, fc->blob, size) && mfOpen(path, &fc->mf) &&
+     validate(fc, fc->mf.data, fc->mf.size, hash)) {
+    free(fc->blob);
+    fc->blob = NULL;
+  } else {
+    mfClose(&fc->mf);
+    fprintf(stderr, "Pre-analyse: impossible d'ecrire %s, resultat garde en memoire\n", path);
+    validate(fc, fc->blob, size, hash);
+  }
+ ready:
+  SDL_AtomicSet(&fc->status, FC_READY);
+  return 0;
+ failed:
+  SDL_AtomicSet(&fc->status, FC_FAILED);
+  return 1;
+}
+
+static fc_cache_t * alloc(int fft_size, int nbands, int hop) {
+  fc_cache_t * fc = (fc_cache_t *)calloc(1, sizeof *fc);
+  if(!fc)
+    return NULL;
+  fc->fft_size = fft_size;
+  fc->nbands = nbands;
+  fc->hop = hop;
+  SDL_AtomicSet(&fc->status, FC_PENDING);
+  return fc;
+}
+
+fc_cache_t * fcLoadAsync(const char * filename, int fft_size, int nbands, int hop) {
+  fc_cache_t * fc = alloc(fft_size, nbands, hop);
+  if(!fc)
+    return NULL;
+  if(!(fc->filename = (char *)malloc(strlen(filename) + 1))) {
+    free(fc);
+    return NULL;
+  }
+  strcpy(fc->filename, filename);
+  if(!(fc->thread = SDL_CreateThread(worker, "pre-analyse", fc)))
+    SDL_AtomicSet(&fc->status, FC_FAILED);
+  return fc;
+}
+
+fc_cache_t * fcLoadPCM(const int16_t * pcm, int frames, int channels, int rate, int fft_size, int nbands, int hop) {
+  fc_cache_t * fc = alloc(fft_size, nbands, hop);
+  if(!fc)
+    return NULL;
+  fc->pcm = pcm;
+  fc->frames = frames;
+  fc->channels = channels;
+  fc->rate = rate;
+  worker(fc);
+  return fc;
+}
+
+int fcStatus(fc_cache_t * fc) {
+  return SDL_AtomicGet(&fc->status);
+}
+
+int fcWait(fc_cache_t * fc) {
+  if(fc->thread) {
+    SDL_WaitThread(fc->thread, NULL);
+    fc->thread = NULL;
+  }
+  return fcStatus(fc);
+}
+
+void fcDelete(fc_cache_t * fc) {
+  if(!fc) return;
+  fcWait(fc);
+  mfClose(&fc->mf);
+  free(fc->blob);
+  free(fc->filename);
+  free(fc);
+}
+
+double fcDuration(fc_cache_t * fc) {
+  return fc->hdr->nframes * (double)fc->hdr->hop / fc->hdr->rate;
+}
+
+float fcTempo(fc_cache_t * fc) {
+  return fc->hdr->tempo;
+}
+
+int fcSample(fc_cache_t * fc, double t, aa_features_t * out) {
+  const fc_header_t * h = fc->hdr;
+  double x = t * h->rate / h->hop - 1.0;
+  uint32_t i0, i1, b;
+  float u;
+  memset(out, 0, sizeof *out);
+  out->nbands = h->nbands;
+  if(x < 0.0 || x > h->nframes - 1)
+    return 0;
+  i0 = (uint32_t)x;
+  i1 = i0 + 1 < h->nframes ? i0 + 1 : i0;
+  u = (float)(x - i0);
+#define FC_LERP(f) (fc->rec[i0].f + u * (fc->rec[i1].f - fc->rec[i0].f))
+  out->level = FC_LERP(level);
+  out->rms[0] = FC_LERP(rms[0]);
+  out->rms[1] = FC_LERP(rms[1]);
+  out->peak = FC_LERP(peak);
+  out->flux = FC_LERP(flux);
+#undef FC_LERP
+  for(b = 0; b < h->nbands; ++b)
+    out->bands[b] = (fc->bands[i0 * h->nbands + b] * (1.0f - u) + fc->bands[i1 * h->nbands + b] * u) / 255.0f;
+  return 1;
+}
+
+double fcNextBeat(fc_cache_t * fc, double t) {
+  uint32_t lo = 0, hi = fc->hdr->nbeats;
+  while(lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if(fc->beats[mid] < t) lo = mid + 1; else hi = mid;
+  }
+  return lo < fc->hdr->nbeats ? fc->beats[lo] : -1.0;
+}
+
+double fcNextOnset(fc_cache_t * fc, double t) {
+  const fc_header_t * h = fc->hdr;
+  /* le pas i décrit l'audio entendu jusqu'à (i + 1) * hop / rate */
+  double x = t * h->rate / h->hop - 1.0;
+  uint32_t lo = 0, hi = h->nonsets;
+  while(lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if(fc->onsets[mid] < x) lo = mid + 1; else hi = mid;
+  }
+  return lo < h->nonsets ? (fc->onsets[lo] + 1.0) * h->hop / h->rate : -1.0;
+}
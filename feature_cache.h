@@ -0,0 +1,64 @@
+/*!\file feature_cache.h
+ *
+ * \brief pré-analyse hors ligne d'un morceau : décodage complet dans
+ * un thread de travail, puis enveloppe, bandes, attaques (onsets) et
+ * grille de temps (beats) à pas fixe, enregistrés dans un cache
+ * binaire compact (dossier cache/) identifié par l'empreinte du
+ * fichier audio et projeté en mémoire aux exécutions suivantes.
+ *
+ * Le rendu consulte ensuite les caractéristiques par position de
+ * lecture, sans analyse en direct et avec possibilité d'anticipation.
+ */
+#ifndef _FEATURE_CACHE_H
+#define _FEATURE_CACHE_H
+
+#include <stdint.h>
+#include "audio_analysis.h"
+
+/*!\brief dossier des caches sur disque. */
+#define FC_CACHE_DIR "cache"
+
+/*!\brief états d'une pré-analyse. */
+enum {
+  FC_PENDING = 0,
+  FC_READY,
+  FC_FAILED
+};
+
+typedef struct fc_cache_t fc_cache_t;
+
+/*!\brief lance la pré-analyse de \a filename dans un thread (FFT de
+ * \a fft_size points, \a nbands bandes, un pas tous les \a hop
+ * échantillons). SDL_mixer doit être ouvert : le décodage se fait au
+ * format du périphérique. Ne retourne NULL qu'en cas d'échec
+ * d'allocation. */
+extern fc_cache_t *  fcLoadAsync(const char * filename, int fft_size, int nbands, int hop);
+/*!\brief comme fcLoadAsync mais analyse directement \a frames trames
+ * PCM 16 bits entrelacées déjà décodées (sans thread, sans fichier
+ * audio) ; le cache est identifié par l'empreinte de \a pcm. */
+extern fc_cache_t *  fcLoadPCM(const int16_t * pcm, int frames, int channels, int rate, int fft_size, int nbands, int hop);
+/*!\brief retourne l'état courant (FC_PENDING, FC_READY, FC_FAILED). */
+extern int           fcStatus(fc_cache_t * fc);
+/*!\brief attend la fin de la pré-analyse et retourne son état. */
+extern int           fcWait(fc_cache_t * fc);
+/*!\brief attend le thread et libère tout. */
+extern void          fcDelete(fc_cache_t * fc);
+
+/* les fonctions suivantes ne sont valides que si l'état est FC_READY */
+
+/*!\brief durée analysée, en secondes. */
+extern double        fcDuration(fc_cache_t * fc);
+/*!\brief tempo estimé en battements par minute. */
+extern float         fcTempo(fc_cache_t * fc);
+/*!\brief caractéristiques à l'instant \a t (secondes), interpolées
+ * linéairement entre deux pas ; retourne 0 hors du morceau (et \a out
+ * est alors mis à zéro). */
+extern int           fcSample(fc_cache_t * fc, double t, aa_features_t * out);
+/*!\brief instant du premier beat de la grille postérieur ou égal à \a
+ * t, -1 s'il n'y en a plus. */
+extern double        fcNextBeat(fc_cache_t * fc, double t);
+/*!\brief instant de la première attaque postérieure ou égale à \a t,
+ * -1 s'il n'y en a plus. */
+extern double        fcNextOnset(fc_cache_t * fc, double t);
+
+#endif
@@ -0,0 +1,95 @@
+/*!\file feature_ring.cpp
+ *
+ * \brief anneau SPSC de caractéristiques audio et enveloppe de
+ * lissage. Voir feature_ring.h.
+ */
+#include "feature_ring.h"
+#include <string.h>
+#include <math.h>
+
+void frInit(fr_ring_t * r) {
+  SDL_AtomicSet(&r->head, 0);
+  SDL_AtomicSet(&r->tail, 0);
+  SDL_AtomicSet(&r->dropped, 0);
+}
+
+int frPush(fr_ring_t * r, const fr_frame_t * fr) {
+  int head = SDL_AtomicGet(&r->head), tail = SDL_AtomicGet(&r->tail);
+  if(head - tail >= FR_CAPACITY) {
+    SDL_AtomicAdd(&r->dropped, 1);
+    return 0;
+  }
+  r->frames[head & (FR_CAPACITY - 1)] = *fr;
+  /* le bloc doit être visible avant la nouvelle tête */
+  SDL_MemoryBarrierRelease();
+  SDL_AtomicSet(&r->head, head + 1);
+  return 1;
+}
+
+int frPop(fr_ring_t * r, fr_frame_t * fr) {
+  int tail = SDL_AtomicGet(&r->tail), head = SDL_AtomicGet(&r->head);
+  if(head == tail)
+    return 0;
+  SDL_MemoryBarrierAcquire();
+  *fr = r->frames[tail & (FR_CAPACITY - 1)];
+  SDL_AtomicSet(&r->tail, tail + 1);
+  return 1;
+}
+
+int frDropped(fr_ring_t * r) {
+  return SDL_AtomicGet(&r->dropped);
+}
+
+void frEnvelopeInit(fr_envelope_t * e, float attack, float release, float decay) {
+  memset(e, 0, sizeof *e);
+  e->attack = attack;
+  e->release = release;
+  e->decay = decay;
+}
+
+/* lissage exponentiel d'une valeur selon le sens de variation */
+static inline float follow(float cur, float target, float ka, float kr) {
+  return cur + (target - cur) * (target > cur ? ka : kr);
+}
+
+static inline float hold(float cur, float v, float fall) {
+  cur -= fall;
+  return v > cur ? v : (cur > 0.0f ? cur : 0.0f);
+}
+
+void frEnvelopeFeed(fr_envelope_t * e, const fr_frame_t * fr) {
+  float dt = (float)fr->duration;
+  float ka = e->attack  > 0.0f ? 1.0f - expf(-dt / e->attack)  : 1.0f;
+  float kr = e->release > 0.0f ? 1.0f - expf(-dt / e->release) : 1.0f;
+  float fall = e->decay * dt;
+  const aa_features_t * f = &fr->f;
+  aa_features_t * s = &e->smooth, * p = &e->peak;
+  int b;
+  s->rms[0] = follow(s->rms[0], f->rms[0], ka, kr);
+  s->rms[1] = follow(s->rms[1], f->rms[1], ka, kr);
+  s->peak   = follow(s->peak,   f->peak,   ka, kr);
+  s->flux   = follow(s->flux,   f->flux,   ka, kr);
+  s->level  = follow(s->level,  f->level,  ka, kr);
+  p->rms[0] = hold(p->rms[0], f->rms[0], fall);
+  p->rms[1] = hold(p->rms[1], f->rms[1], fall);
+  p->peak   = hold(p->peak,   f->peak,   fall);
+  p->flux   = hold(p->flux,   f->flux,   fall);
+  p->level  = hold(p->level,  f->level,  fall);
+  s->nbands = p->nbands = f->nbands;
+  for(b = 0; b < f->nbands; ++b) {
+    s->bands[b] = follow(s->bands[b], f->bands[b], ka, kr);
+    p->bands[b] = hold(p->bands[b], f->bands[b], fall);
+  }
+  e->last = *fr;
+}
+
+int frDrain(fr_ring_t * r, fr_envelope_t * e) {
+  fr_frame_t fr;
+  int n = 0;
+  while(frPop(r, &fr)) {
+    frEnvelopeFeed(e, &fr);
+    ++n;
+  }
+  e->count = n;
+  return n;
+}
@@ -0,0 +1,87 @@
+/*!\file feature_ring.h
+ *
+ * \brief transmission sans verrou des caractéristiques audio du thread
+ * de SDL_mixer (producteur unique, mixCallback) vers le thread de
+ * rendu (consommateur unique, draw).
+ *
+ * Chaque bloc analysé est poussé horodaté dans un anneau ; draw vide
+ * l'anneau à chaque frame et intègre tous les blocs reçus depuis la
+ * frame précédente dans une enveloppe (lissage attaque/relâchement et
+ * maintien de crête). Le thread audio ne bloque jamais : si l'anneau
+ * est plein, le bloc est perdu et compté.
+ */
+#ifndef _FEATURE_RING_H
+#define _FEATURE_RING_H
+
+#include <SDL.h>
+#include "audio_analysis.h"
+
+/*!\brief nombre de blocs de l'anneau (puissance de 2) ; à 1024
+ * trames par bloc cela couvre ~6s d'audio. */
+#define FR_CAPACITY 256
+
+/*!\brief un bloc analysé et horodaté. */
+typedef struct fr_frame_t fr_frame_t;
+struct fr_frame_t {
+  /*!\brief début du bloc dans le flux audio, en secondes (compte des
+   * échantillons / fréquence). */
+  double t;
+  /*!\brief durée du bloc en secondes. */
+  double duration;
+  /*!\brief instant de l'appel de la callBack, en secondes (horloge
+   * SDL_GetPerformanceCounter). */
+  double wall;
+  aa_features_t f;
+};
+
+/*!\brief l'anneau ; head n'est écrit que par le producteur, tail que
+ * par le consommateur, chacun sur sa propre ligne de cache. */
+typedef struct fr_ring_t fr_ring_t;
+struct fr_ring_t {
+  SDL_atomic_t head;
+  char _pad0[64 - sizeof(SDL_atomic_t)];
+  SDL_atomic_t tail;
+  char _pad1[64 - sizeof(SDL_atomic_t)];
+  SDL_atomic_t dropped;
+  fr_frame_t frames[FR_CAPACITY];
+};
+
+/*!\brief état lissé côté rendu. */
+typedef struct fr_envelope_t fr_envelope_t;
+struct fr_envelope_t {
+  /*!\brief constantes de temps (secondes) de montée et de descente du lissage. */
+  float attack, release;
+  /*!\brief vitesse de décroissance (unités par seconde) des crêtes maintenues. */
+  float decay;
+  /*!\brief caractéristiques lissées. */
+  aa_features_t smooth;
+  /*!\brief crêtes maintenues, décroissant linéairement. */
+  aa_features_t peak;
+  /*!\brief dernier bloc intégré (brut). */
+  fr_frame_t last;
+  /*!\brief nombre de blocs intégrés lors du dernier frDrain. */
+  int count;
+};
+
+/*!\brief remet l'anneau \a r à vide. À n'appeler qu'avant le
+ * démarrage du producteur. */
+extern void frInit(fr_ring_t * r);
+/*!\brief côté producteur : ajoute \a fr ; retourne 0 (et compte une
+ * perte) si l'anneau est plein. */
+extern int  frPush(fr_ring_t * r, const fr_frame_t * fr);
+/*!\brief côté consommateur : retire le plus ancien bloc dans \a fr ;
+ * retourne 0 si l'anneau est vide. */
+extern int  frPop(fr_ring_t * r, fr_frame_t * fr);
+/*!\brief nombre de blocs perdus depuis frInit. */
+extern int  frDropped(fr_ring_t * r);
+
+/*!\brief initialise l'enveloppe \a e avec ses constantes de temps. */
+extern void frEnvelopeInit(fr_envelope_t * e, float attack, float release, float decay);
+/*!\brief intègre le bloc \a fr dans l'enveloppe \a e, en utilisant sa
+ * propre durée comme pas de temps. */
+extern void frEnvelopeFeed(fr_envelope_t * e, const fr_frame_t * fr);
+/*!\brief côté consommateur : vide l'anneau \a r dans l'enveloppe \a
+ * e et retourne le nombre de blocs intégrés. */
+extern int  frDrain(fr_ring_t * r, fr_envelope_t * e);
+
+#endif
@@ -0,0 +1,50 @@
+/*!\file frame_pacer.cpp
+ *
+ * \brief régulateur de cadence. Voir frame_pacer.h.
+ */
+#include "frame_pacer.h"
+#include <SDL.h>
+#include <math.h>
+
+/* marge d'attente active, en secondes */
+#define FP_SPIN 0.0015
+/* retard toléré sans sauter d'échéance, en fraction de l'intervalle */
+#define FP_TOLERANCE 0.1
+
+static double _interval = 1.0 / 60.0, _last = 0.0;
+static int _missed = 0;
+
+static double maintenant(void) {
+  return SDL_GetPerformanceCounter() / (double)SDL_GetPerformanceFrequency();
+}
+
+void fpInit(double hz) {
+  _interval = hz > 0.0 ? 1.0 / hz : 1.0 / 60.0;
+  _last = 0.0;
+  _missed = 0;
+}
+
+double fpWait(void) {
+  double now = maintenant(), next = _last + _interval, pas;
+  if(_last <= 0.0) {
+    _last = now;
+    return 0.0;
+  }
+  if(now > next + FP_TOLERANCE * _interval) {
+    /* en retard : échéance suivante de la grille */
+    double k = ceil((now - next) / _interval);
+    _missed += (int)k;
+    next += k * _interval;
+  }
+  if(next - now > FP_SPIN)
+    SDL_Delay((Uint32)((next - now - FP_SPIN) * 1000.0));
+  while(maintenant() < next)
+    ;
+  pas = next - _last;
+  _last = next;
+  return pas;
+}
+
+int fpMissed(void) {
+  return _missed;
+}
@@ -0,0 +1,25 @@
+/*!\file frame_pacer.h
+ *
+ * \brief régulateur de cadence : chaque frame est terminée à une
+ * échéance fixe (un multiple de l'intervalle visé) plutôt qu'au plus
+ * tôt, pour que les images soient présentées à intervalles réguliers
+ * et que l'animation avance d'un pas constant.
+ *
+ * L'attente se fait en SDL_Delay puis, pour la dernière milliseconde,
+ * en attente active sur le compteur haute résolution. Une échéance
+ * manquée n'est pas rattrapée : la suivante est recalée sur la
+ * grille, l'intervalle de la frame vaut alors plusieurs pas.
+ */
+#ifndef _FRAME_PACER_H
+#define _FRAME_PACER_H
+
+/*!\brief vise \a hz images par seconde. */
+extern void   fpInit(double hz);
+/*!\brief attend l'échéance de la frame en cours et retourne
+ * l'intervalle (secondes) écoulé depuis l'échéance précédente, un
+ * multiple de 1 / hz (0 à la première frame). */
+extern double fpWait(void);
+/*!\brief nombre d'échéances manquées. */
+extern int    fpMissed(void);
+
+#endif
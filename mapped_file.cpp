@@ -0,0 +1,130 @@
+/*!\file mapped_file.cpp
+ *
+ * \brief projection en mémoire de fichiers. Voir mapped_file.h.
+ */
+#include "mapped_file.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  include <direct.h>
+#  define MF_MKDIR(d) _mkdir(d)
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#  define MF_MKDIR(d) mkdir(d, 0755)
+#endif
+
+int mfOpen(const char * path, mf_file_t * mf) {
+  memset(mf, 0, sizeof *mf);
+#ifdef _WIN32
+  LARGE_INTEGER sz;
+  HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL), m;
+  if(f == INVALID_HANDLE_VALUE)
+    return 0;
+  if(!GetFileSizeEx(f, &sz) || sz.QuadPart == 0 ||
+     !(m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL))) {
+    CloseHandle(f);
+    return 0;
+  }
+  if(!(mf->data = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0))) {
+    CloseHandle(m);
+    CloseHandle(f);
+    return 0;
+  }
+  mf->size = (size_t)sz.QuadPart;
+  mf->_handle = f;
+  mf->_mapping = m;
+#else
+  struct stat st;
+  void * p;
+  int fd = open(path, O_RDONLY);
+  if(fd < 0)
+    return 0;
+  if(fstat(fd, &st) < 0 || st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+  p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  /* la projection reste valide après fermeture du descripteur */
+  close(fd);
+  if(p == MAP_FAILED)
+    return 0;
+  mf->data = p;
+  mf->size = (size_t)st.st_size;
+#endif
+  return 1;
+}
+
+void mfClose(mf_file_t * mf) {
+  if(!mf->data)
+    return;
+#ifdef _WIN32
+  UnmapViewOfFile(mf->data);
+  CloseHandle((HANDLE)mf->_mapping);
+  CloseHandle((HANDLE)mf->_handle);
+#else
+  munmap((void *)mf->data, mf->size);
+#endif
+  memset(mf, 0, sizeof *mf);
+}
+
+uint64_t mfHash(const void * data, size_t size, uint64_t seed) {
+  const uint8_t * p = (const uint8_t *)data;
+  uint64_t h = seed;
+  size_t i;
+  for(i = 0; i < size; ++i) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+int mfHashFile(const char * path, uint64_t * hash) {
+  mf_file_t mf;
+  if(!mfOpen(path, &mf))
+    return 0;
+  *hash = mfHash(mf.data, mf.size, MF_HASH_SEED);
+  mfClose(&mf);
+  return 1;
+}
+
+/* crée le dossier parent de path s'il n'existe pas (un seul niveau) */
+static void makeParentDir(const char * path) {
+  char dir[512];
+  const char * s = strrchr(path, '/');
+#ifdef _WIN32
+  const char * bs = strrchr(path, '\\');
+  if(bs > s) s = bs;
+#endif
+  if(!s || (size_t)(s - path) >= sizeof dir)
+    return;
+  memcpy(dir, path, s - path);
+  dir[s - path] = '\0';
+  MF_MKDIR(dir);
+}
+
+int mfWriteAtomic(const char * path, const void * data, size_t size) {
+  char tmp[512];
+  FILE * f;
+  int ok;
+  if(snprintf(tmp, sizeof tmp, "%s.tmp", path) >= (int)sizeof tmp)
+    return 0;
+  makeParentDir(path);
+  if(!(f = fopen(tmp, "wb")))
+    return 0;
+  ok = fwrite(data, 1, size, f) == size;
+  ok = (fclose(f) == 0) && ok;
+#ifdef _WIN32
+  /* rename ne remplace pas un fichier existant sous Windows */
+  ok = ok && MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING);
+#else
+  ok = ok && rename(tmp, path) == 0;
+#endif
+  if(!ok)
+    remove(tmp);
+  return ok;
+}
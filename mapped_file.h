@@ -0,0 +1,43 @@
+/*!\file mapped_file.h
+ *
+ * \brief projection en mémoire (lecture seule) d'un fichier, POSIX
+ * (mmap) ou Windows (MapViewOfFile), et quelques utilitaires de
+ * fichiers partagés par les caches sur disque.
+ */
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!\brief un fichier projeté en mémoire. */
+typedef struct mf_file_t mf_file_t;
+struct mf_file_t {
+  /*!\brief début des données projetées (NULL si non ouvert). */
+  const void * data;
+  /*!\brief taille en octets. */
+  size_t size;
+  /* descripteurs propres au système */
+  void * _handle, * _mapping;
+};
+
+/*!\brief projette le fichier \a path dans \a mf ; retourne 0 en cas
+ * d'échec (fichier absent ou vide). */
+extern int      mfOpen(const char * path, mf_file_t * mf);
+/*!\brief libère la projection \a mf (sans effet si non ouverte). */
+extern void     mfClose(mf_file_t * mf);
+/*!\brief empreinte FNV-1a 64 bits de \a size octets de \a data. */
+extern uint64_t mfHash(const void * data, size_t size, uint64_t seed);
+/*!\brief empreinte du contenu du fichier \a path dans \a hash ;
+ * retourne 0 si le fichier ne peut être lu. */
+extern int      mfHashFile(const char * path, uint64_t * hash);
+/*!\brief écrit \a size octets de \a data dans \a path, via un fichier
+ * temporaire renommé ensuite (un lecteur ne voit jamais de cache à
+ * moitié écrit) ; crée le dossier parent s'il manque. Retourne 0 en
+ * cas d'échec. */
+extern int      mfWriteAtomic(const char * path, const void * data, size_t size);
+
+/*!\brief valeur initiale de l'empreinte FNV-1a 64 bits. */
+#define MF_HASH_SEED 0xcbf29ce484222325ULL
+
+#endif
@@ -0,0 +1,207 @@
+/*!\file meshes.cpp
+ *
+ * \brief génération de maillages indexés. Voir meshes.h.
+ */
+#include "meshes.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+#  define M_PI 3.14159265358979323846
+#endif
+
+/* sommet entrelacé : position, normale, coordonnée de texture */
+typedef struct { GLfloat p[3], n[3], t[2]; } vertex_t;
+
+static void setVertex(vertex_t * v, float px, float py, float pz, float nx, float ny, float nz, float s, float t) {
+  v->p[0] = px; v->p[1] = py; v->p[2] = pz;
+  v->n[0] = nx; v->n[1] = ny; v->n[2] = nz;
+  v->t[0] = s;  v->t[1] = t;
+}
+
+/* transfère sommets et indices vers le GPU et prépare le VAO */
+static int upload(ms_mesh_t * m, const vertex_t * v, GLsizei nv, const GLuint * idx, GLsizei ni) {
+  memset(m, 0, sizeof *m);
+  glGenVertexArrays(1, &m->vao);
+  glGenBuffers(1, &m->vbo);
+  glGenBuffers(1, &m->ibo);
+  glBindVertexArray(m->vao);
+  glBindBuffer(GL_ARRAY_BUFFER, m->vbo);
+  glBufferData(GL_ARRAY_BUFFER, nv * sizeof *v, v, GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof *v, (const void *)offsetof(vertex_t, p));
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof *v, (const void *)offsetof(vertex_t, n));
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof *v, (const void *)offsetof(vertex_t, t));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, ni * sizeof *idx, idx, GL_STATIC_DRAW);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  m->count = ni;
+  return 1;
+}
+
+/* indices d'une grille de (w + 1) x (h + 1) sommets */
+static void gridIndices(GLuint * idx, int w, int h, GLuint base) {
+  int i, j;
+  for(i = 0; i < h; ++i)
+    for(j = 0; j < w; ++j) {
+      GLuint a = base + i * (w + 1) + j, b = a + 1, c = a + (w + 1), d = c + 1;
+      *idx++ = a; *idx++ = b; *idx++ = c;
+      *idx++ = b; *idx++ = d; *idx++ = c;
+    }
+}
+
+int msGenSphere(ms_mesh_t * m, int slices, int stacks) {
+  int i, j, nv = (slices + 1) * (stacks + 1), ni = 6 * slices * stacks, r;
+  vertex_t * v = (vertex_t *)malloc(nv * sizeof *v);
+  GLuint * idx = (GLuint *)malloc(ni * sizeof *idx);
+  if(!v || !idx) {
+    free(v); free(idx);
+    return 0;
+  }
+  for(i = 0; i <= stacks; ++i) {
+    double phi = M_PI * i / stacks - M_PI / 2.0;
+    for(j = 0; j <= slices; ++j) {
+      double theta = 2.0 * M_PI * j / slices;
+      float x = (float)(cos(phi) * cos(theta)), y = (float)sin(phi), z = (float)(cos(phi) * sin(theta));
+      setVertex(&v[i * (slices + 1) + j], x, y, z, x, y, z, (float)j / slices, (float)i / stacks);
+    }
+  }
+  gridIndices(idx, slices, stacks, 0);
+  r = upload(m, v, nv, idx, ni);
+  free(v); free(idx);
+  return r;
+}
+
+int msGenCone(ms_mesh_t * m, int slices, int stacks) {
+  /* flanc : une grille de stacks + 1 rangées (de la base au sommet) ;
+   * fond : centre + cercle */
+  int i, j, nside = (stacks + 1) * (slices + 1), nv = nside + 1 + (slices + 1), ni = 6 * slices * stacks + 3 * slices, r;
+  const float k = 1.0f / sqrtf(5.0f);
+  vertex_t * v = (vertex_t *)malloc(nv * sizeof *v);
+  GLuint * idx = (GLuint *)malloc(ni * sizeof *idx), * p;
+  if(!v || !idx) {
+    free(v); free(idx);
+    return 0;
+  }
+  for(j = 0; j <= slices; ++j) {
+    double theta = 2.0 * M_PI * j / slices;
+    float c = (float)cos(theta), s = (float)sin(theta);
+    /* normale du flanc pour une hauteur 2 et un rayon 1 */
+    for(i = 0; i <= stacks; ++i) {
+      float h = (float)i / stacks, rayon = 1.0f - h;
+      setVertex(&v[i * (slices + 1) + j], rayon * c, 2.0f * h - 1.0f, rayon * s, 2.0f * k * c, k, 2.0f * k * s, (float)j / slices, h);
+    }
+    setVertex(&v[nside + 1 + j], c, -1.0f, s, 0.0f, -1.0f, 0.0f, 0.5f + 0.5f * c, 0.5f + 0.5f * s);
+  }
+  setVertex(&v[nside], 0.0f, -1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.5f, 0.5f);
+  gridIndices(idx, slices, stacks, 0);
+  p = idx + 6 * slices * stacks;
+  for(j = 0; j < slices; ++j) {
+    *p++ = nside;
+    *p++ = nside + 1 + j;
+    *p++ = nside + 2 + j;
+  }
+  r = upload(m, v, nv, idx, ni);
+  free(v); free(idx);
+  return r;
+}
+
+int msGenQuad(ms_mesh_t * m) {
+  vertex_t v[4];
+  GLuint idx[6];
+  setVertex(&v[0], -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
+  setVertex(&v[1],  1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
+  setVertex(&v[2], -1.0f,  1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f);
+  setVertex(&v[3],  1.0f,  1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
+  gridIndices(idx, 1, 1, 0);
+  return upload(m, v, 4, idx, 6);
+}
+
+void msAttachInstances(ms_mesh_t * m, GLuint vbo, GLintptr offset, GLsizei stride) {
+  int c;
+  glBindVertexArray(m->vao);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  /* une mat4 occupe 4 locations consécutives, une par colonne */
+  for(c = 0; c < 5; ++c) {
+    glEnableVertexAttribArray(MS_INSTANCE_LOCATION + c);
+    glVertexAttribPointer(MS_INSTANCE_LOCATION + c, 4, GL_FLOAT, GL_FALSE, stride,
+			  (const void *)(offset + c * 4 * sizeof(GLfloat)));
+    glVertexAttribDivisor(MS_INSTANCE_LOCATION + c, 1);
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void msDrawInstanced(const ms_mesh_t * m, GLsizei instances) {
+  glBindVertexArray(m->vao);
+  glDrawElementsInstanced(GL_TRIANGLES, m->count, GL_UNSIGNED_INT, 0, instances);
+  glBindVertexArray(0);
+}
+
+void msDraw(const ms_mesh_t * m) {
+  glBindVertexArray(m->vao);
+  glDrawElements(GL_TRIANGLES, m->count, GL_UNSIGNED_INT, 0);
+  glBindVertexArray(0);
+}
+
+void msDelete(ms_mesh_t * m) {
+  if(m->vao) glDeleteVertexArrays(1, &m->vao);
+  if(m->vbo) glDeleteBuffers(1, &m->vbo);
+  if(m->ibo) glDeleteBuffers(1, &m->ibo);
+  memset(m, 0, sizeof *m);
+}
+
+/* niveaux k = 0..MS_LOD_LEVELS - 1 de \a slices x 2^k côtés et \a
+ * stacks x 2^k rangées, générés par gen (msGenSphere ou msGenCone) */
+static int genLod(ms_lod_t * l, int (*gen)(ms_mesh_t *, int, int), int slices, int stacks) {
+  int k;
+  memset(l, 0, sizeof *l);
+  for(k = 0; k < MS_LOD_LEVELS; ++k) {
+    if(!gen(&l->levels[k], slices << k, stacks << k)) {
+      msDeleteLod(l);
+      return 0;
+    }
+    l->slices[k] = slices << k;
+  }
+  return 1;
+}
+
+int msGenSphereLod(ms_lod_t * l, int slices, int stacks) {
+  return genLod(l, msGenSphere, slices, stacks);
+}
+
+int msGenConeLod(ms_lod_t * l, int slices, int stacks) {
+  return genLod(l, msGenCone, slices, stacks);
+}
+
+float msScreenRadius(const GLfloat * proj, const GLfloat * view, const GLfloat * model, float radius, int viewport_h) {
+  /* centre (dernière colonne de model) en coordonnées de vue, et
+   * échelle (uniforme) portée par la première colonne */
+  float x = model[3], y = model[7], z = model[11];
+  float zv = view[8] * x + view[9] * y + view[10] * z + view[11];
+  float s = sqrtf(model[0] * model[0] + model[4] * model[4] + model[8] * model[8]);
+  /* derrière ou tout contre la caméra : le plus fin */
+  if(zv > -1e-3f)
+    return (float)viewport_h;
+  return 0.5f * viewport_h * proj[5] * radius * s / -zv;
+}
+
+int msSelectLod(const ms_lod_t * l, float pixels) {
+  int k;
+  /* longueur à l'écran d'un côté de la silhouette, 2 pi r / slices */
+  for(k = 0; k < MS_LOD_LEVELS - 1; ++k)
+    if(2.0f * (float)M_PI * pixels / l->slices[k] <= MS_LOD_EDGE)
+      break;
+  return k;
+}
+
+void msDeleteLod(ms_lod_t * l) {
+  int k;
+  for(k = 0; k < MS_LOD_LEVELS; ++k)
+    msDelete(&l->levels[k]);
+}
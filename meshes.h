@@ -0,0 +1,76 @@
+/*!\file meshes.h
+ *
+ * \brief génération de maillages indexés (sphère, cône, quadrilatère)
+ * équivalents aux primitives GL4D, avec un VAO dont on garde la
+ * maîtrise (ce que gl4dgDraw ne permet pas) pour le rendu instancié.
+ *
+ * Les sommets suivent la disposition attendue par light_n_tex.vs :
+ * position (location 0), normale (1), coordonnée de texture (2).
+ */
+#ifndef _MESHES_H
+#define _MESHES_H
+
+#include <GL4D/gl4dummies.h>
+
+/*!\brief première location des attributs d'instance : une mat4 de
+ * modélisation (4 locations) puis une couleur vec4. */
+#define MS_INSTANCE_LOCATION 3
+
+/*!\brief nombre de niveaux de détail d'une primitive ; chacun a deux
+ * fois plus de côtés et de rangées que le précédent. */
+#define MS_LOD_LEVELS 4
+/*!\brief longueur visée (pixels) d'un côté de la silhouette. */
+#define MS_LOD_EDGE   8.0f
+
+/*!\brief un maillage indexé (triangles, indices 32 bits). */
+typedef struct ms_mesh_t ms_mesh_t;
+struct ms_mesh_t {
+  GLuint vao, vbo, ibo;
+  GLsizei count;
+};
+
+/*!\brief niveaux de détail d'une primitive, du plus grossier au plus
+ * fin, et nombre de côtés de chacun. */
+typedef struct ms_lod_t ms_lod_t;
+struct ms_lod_t {
+  ms_mesh_t levels[MS_LOD_LEVELS];
+  int slices[MS_LOD_LEVELS];
+};
+
+/*!\brief sphère unité de \a slices méridiens et \a stacks parallèles. */
+extern int  msGenSphere(ms_mesh_t * m, int slices, int stacks);
+/*!\brief cône d'axe y, de hauteur 2 (y dans [-1, 1]) et de rayon 1 à
+ * la base, avec \a slices côtés et \a stacks rangées sur la hauteur. */
+extern int  msGenCone(ms_mesh_t * m, int slices, int stacks);
+/*!\brief quadrilatère [-1, 1]^2 du plan z = 0, normale +z. */
+extern int  msGenQuad(ms_mesh_t * m);
+/*!\brief branche le buffer d'instances \a vbo (à partir de l'octet \a
+ * offset, \a stride octets par instance : mat4 puis vec4) sur les
+ * attributs d'instance du VAO de \a m. */
+extern void msAttachInstances(ms_mesh_t * m, GLuint vbo, GLintptr offset, GLsizei stride);
+/*!\brief dessine \a instances instances de \a m. */
+extern void msDrawInstanced(const ms_mesh_t * m, GLsizei instances);
+/*!\brief dessine \a m une fois. */
+extern void msDraw(const ms_mesh_t * m);
+/*!\brief libère les objets GL de \a m. */
+extern void msDelete(ms_mesh_t * m);
+/*!\brief niveaux de détail d'une sphère ; le plus grossier a \a
+ * slices méridiens et \a stacks parallèles. */
+extern int  msGenSphereLod(ms_lod_t * l, int slices, int stacks);
+/*!\brief niveaux de détail d'un cône ; le plus grossier a \a slices
+ * côtés et \a stacks rangées. */
+extern int  msGenConeLod(ms_lod_t * l, int slices, int stacks);
+/*!\brief rayon à l'écran (pixels) d'une sphère englobante de rayon \a
+ * radius dans l'espace objet de \a model (échelle uniforme), pour les
+ * matrices \a proj et \a view (par lignes comme celles de GL4D) et
+ * une vue de \a viewport_h pixels de haut. */
+extern float msScreenRadius(const GLfloat * proj, const GLfloat * view, const GLfloat * model,
+			    float radius, int viewport_h);
+/*!\brief niveau de \a l le plus grossier dont les côtés de la
+ * silhouette font au plus MS_LOD_EDGE pixels pour un rayon à l'écran de
+ * \a pixels (le plus fin sinon). */
+extern int  msSelectLod(const ms_lod_t * l, float pixels);
+/*!\brief libère tous les niveaux de \a l. */
+extern void msDeleteLod(ms_lod_t * l);
+
+#endif
@@ -0,0 +1,150 @@
+/*!\file offline.cpp
+ *
+ * \brief rendu hors ligne dans un framebuffer et relecture par PBO.
+ * Voir offline.h.
+ */
+#include "offline.h"
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#  include <io.h>
+#  include <fcntl.h>
+#endif
+
+static GLuint _fbo = 0, _rbo[2] = { 0, 0 }, _pbo[2] = { 0, 0 };
+static int _w = 0, _h = 0;
+/* frames relues (lancées) et écrites (ou tentées) */
+static int _lues = 0, _ecrites = 0;
+static FILE * _out = NULL;
+
+void olPrepareEnv(void) {
+  /* pas de carte son sur les machines de construction */
+  SDL_setenv("SDL_AUDIODRIVER", "dummy", 0);
+#ifndef _WIN32
+  if(getenv("DISPLAY") || getenv("WAYLAND_DISPLAY"))
+    return;
+  /* dernier argument à 0 : ne pas écraser un choix de l'utilisateur */
+  SDL_setenv("SDL_VIDEODRIVER", "offscreen", 0);
+  SDL_setenv("EGL_PLATFORM", "surfaceless", 0);
+#endif
+}
+
+int olInit(const char * path, int w, int h) {
+  size_t taille = (size_t)w * h * 4;
+  int i;
+  _w = w;
+  _h = h;
+  if(!strcmp(path, "-")) {
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    _out = stdout;
+  } else if(!(_out = fopen(path, "wb"))) {
+    fprintf(stderr, "Hors ligne: impossible d'ouvrir %s\n", path);
+    return 0;
+  }
+  /* tampon de sortie d'une image entière */
+  setvbuf(_out, NULL, _IOFBF, taille);
+  /* couleur et profondeur en renderbuffers : rien n'est échantillonné */
+  glGenRenderbuffers(2, _rbo);
+  glBindRenderbuffer(GL_RENDERBUFFER, _rbo[0]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+  glBindRenderbuffer(GL_RENDERBUFFER, _rbo[1]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glGenFramebuffers(1, &_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _rbo[0]);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _rbo[1]);
+  i = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if(!i) {
+    fprintf(stderr, "Hors ligne: framebuffer %dx%d incomplet\n", w, h);
+    return 0;
+  }
+  glGenBuffers(2, _pbo);
+  for(i = 0; i < 2; ++i) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, taille, NULL, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  _lues = _ecrites = 0;
+  return 1;
+}
+
+void olBeginFrame(void) {
+  glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+  glViewport(0, 0, _w, _h);
+}
+
+/* écrit la frame relue dans le PBO i, retournée (OpenGL remplit de bas en haut) */
+static int ecrire(int i) {
+  const char * p;
+  int y, ok = 1;
+  size_t ligne = (size_t)_w * 4;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo[i]);
+  if(!(p = (const char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, ligne * _h, GL_MAP_READ_BIT))) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return 0;
+  }
+  for(y = _h - 1; y >= 0 && ok; --y)
+    ok = fwrite(p + y * ligne, 1, ligne, _out) == ligne;
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  ++_ecrites;
+  return ok;
+}
+
+int olEndFrame(void) {
+  int ok = 1;
+  /* relecture asynchrone : glReadPixels vers un PBO retourne aussitôt */
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo[_lues & 1]);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, _w, _h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  ++_lues;
+  /* la frame précédente a eu toute une frame pour arriver */
+  if(_lues > 1)
+    ok = ecrire(_lues & 1);
+  return ok;
+}
+
+int olFinish(void) {
+  int ok = 1;
+  if(_lues > _ecrites)
+    ok = ecrire((_lues - 1) & 1);
+  if(_out)
+    ok = !fflush(_out) && ok;
+  return ok;
+}
+
+int olFrames(void) {
+  return _ecrites;
+}
+
+void olQuit(void) {
+  if(_out) {
+    if(_out != stdout)
+      fclose(_out);
+    else
+      fflush(_out);
+    _out = NULL;
+  }
+  if(_pbo[0]) {
+    glDeleteBuffers(2, _pbo);
+    _pbo[0] = _pbo[1] = 0;
+  }
+  if(_fbo) {
+    glDeleteFramebuffers(1, &_fbo);
+    _fbo = 0;
+  }
+  if(_rbo[0]) {
+    glDeleteRenderbuffers(2, _rbo);
+    _rbo[0] = _rbo[1] = 0;
+  }
+}
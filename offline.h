@@ -0,0 +1,38 @@
+/*!\file offline.h
+ *
+ * \brief rendu hors ligne (sans écran ni carte graphique) : chaque
+ * frame est dessinée dans un framebuffer hors écran puis relue de
+ * façon asynchrone à travers deux pixel buffer objects alternés ; la
+ * frame n est écrite pendant que le GPU (ou llvmpipe) relit la frame
+ * n + 1. Les images sont écrites brutes (RGBA 8 bits, de haut en bas)
+ * dans un fichier ou sur la sortie standard, par exemple vers :
+ *
+ * ffmpeg -f rawvideo -pix_fmt rgba -s 800x800 -r 30 -i - video.mp4
+ */
+#ifndef _OFFLINE_H
+#define _OFFLINE_H
+
+#include <GL4D/gl4dummies.h>
+
+/*!\brief à appeler avant la création de la fenêtre : demande à SDL
+ * le pilote audio muet et, sans affichage disponible, son pilote
+ * vidéo hors écran (EGL, Mesa surfaceless) ; les variables déjà
+ * positionnées sont respectées. */
+extern void olPrepareEnv(void);
+/*!\brief créé le framebuffer \a w x \a h et ouvre \a path en écriture
+ * ("-" pour la sortie standard). Retourne 0 en cas d'échec. */
+extern int  olInit(const char * path, int w, int h);
+/*!\brief dirige le dessin de la frame vers le framebuffer hors écran. */
+extern void olBeginFrame(void);
+/*!\brief lance la relecture de la frame dessinée et écrit la
+ * précédente. Retourne 0 si l'écriture a échoué. */
+extern int  olEndFrame(void);
+/*!\brief écrit la dernière frame en attente. Retourne 0 si l'écriture
+ * a échoué. */
+extern int  olFinish(void);
+/*!\brief nombre de frames écrites. */
+extern int  olFrames(void);
+/*!\brief libère le framebuffer, les buffers et ferme la sortie. */
+extern void olQuit(void);
+
+#endif
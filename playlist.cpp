@@ -0,0 +1,293 @@
+/*!\file playlist.cpp
+ *
+ * \brief lecture enchaînée d'une liste de morceaux. Voir playlist.h.
+ *
+ * Les morceaux lisibles sont décodés alternativement dans les deux
+ * emplacements. Un sémaphore compte les emplacements libres : le thread de
+ * décodage en prend un avant chaque morceau (et y libère le morceau
+ * précédent), la callBack le rend quand elle passe au morceau suivant.
+ */
+#include "playlist.h"
+#include "profiler.h"
+#include <SDL.h>
+#include <SDL_mixer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct pl_slot_t pl_slot_t;
+struct pl_slot_t {
+  /* morceau décodé par SDL_mixer, gardé tel quel : ses échantillons
+   * sont lus directement, sans copie */
+  Mix_Chunk * chunk;
+  const int16_t * pcm;
+  Uint32 frames;
+  /* indice du morceau décodé */
+  int track;
+  /* 1 quand le morceau est décodé, remis à 0 par la callBack */
+  SDL_atomic_t ready;
+};
+
+struct pl_playlist_t {
+  char ** files;
+  int n;
+  int fft_size, nbands, hop;
+  int rate, channels;
+  pl_slot_t slots[2];
+  SDL_sem * free;
+  SDL_Thread * thread;
+  /* quit : arrêt demandé ; done : toute la liste a été décodée */
+  SDL_atomic_t quit, done;
+  /* pré-analyses publiées par le thread de décodage ; celles
+   * d'indice < released ont été libérées par le rendu */
+  fc_cache_t ** fc;
+  int released;
+  /* trame du flux où chaque morceau a commencé, started premières
+   * valides ; écrites par la callBack */
+  Uint64 * starts;
+  SDL_atomic_t started;
+  /* état de la callBack : morceau joué, emplacements utilisés */
+  int cur, used;
+  Uint32 pos;
+  Uint64 mixed, underruns;
+  /* compteur de la callBack de post-mixage, lu au premier bloc */
+  const uint64_t * clock;
+};
+
+static int decoder(void * arg) {
+  pl_playlist_t * pl = (pl_playlist_t *)arg;
+  int i, k = 0, libre = 0;
+  pfThreadName("playlist");
+  for(i = 0; i < pl->n; ++i) {
+    pl_slot_t * s = &pl->slots[k & 1];
+    Mix_Chunk * chunk;
+    fc_cache_t * fc = NULL;
+    /* attendre que la callBack ait quitté l'avant-dernier morceau
+     * décodé (sauf si l'emplacement n'a pas servi) */
+    if(!libre)
+      SDL_SemWait(pl->free);
+    libre = 1;
+    if(SDL_AtomicGet(&pl->quit))
+      break;
+    pfBegin("decode morceau");
+    /* le morceau qui occupait l'emplacement n'est plus joué */
+    if(s->chunk) {
+      Mix_FreeChunk(s->chunk);
+      s->chunk = NULL;
+      s->pcm = NULL;
+    }
+    s->frames = 0;
+    if(!(chunk = Mix_LoadWAV(pl->files[i])))
+      fprintf(stderr, "Playlist: %s: %s\n", pl->files[i], Mix_GetError());
+    else if(!(s->frames = chunk->alen / (2 * pl->channels)))
+      Mix_FreeChunk(chunk);
+    else {
+      s->chunk = chunk;
+      s->pcm = (const int16_t *)chunk->abuf;
+    }
+    pfEnd();
+    /* un morceau illisible est sauté, son emplacement sert au suivant */
+    if(!s->frames)
+      continue;
+    s->track = i;
+    SDL_AtomicSet(&s->ready, 1);
+    libre = 0;
+    ++k;
+    /* pré-analyse (ou cache) du PCM décodé, pendant qu'il est joué */
+    if(pl->fft_size > 0)
+      fc = fcLoadPCM(s->pcm, s->frames, pl->channels, pl->rate, pl->fft_size, pl->nbands, pl->hop);
+    SDL_AtomicSetPtr((void **)&pl->fc[i], fc);
+  }
+  SDL_AtomicSet(&pl->done, 1);
+  return 0;
+}
+
+pl_playlist_t * plNew(const char ** files, int n, int fft_size, int nbands, int hop) {
+  pl_playlist_t * pl;
+  Uint16 format;
+  int i;
+  if(n <= 0 || !(pl = (pl_playlist_t *)calloc(1, sizeof *pl)))
+    return NULL;
+  pl->n = n;
+  pl->fft_size = fft_size;
+  pl->nbands = nbands;
+  pl->hop = hop;
+  pl->cur = -1;
+  if(!Mix_QuerySpec(&pl->rate, &format, &pl->channels) || format != AUDIO_S16SYS)
+    goto failed;
+  if(!(pl->files = (char **)calloc(n, sizeof *pl->files)) || !(pl->fc = (fc_cache_t **)calloc(n, sizeof *pl->fc)) ||
+     !(pl->starts = (Uint64 *)calloc(n, sizeof *pl->starts)))
+    goto failed;
+  for(i = 0; i < n; ++i) {
+    if(!(pl->files[i] = (char *)malloc(strlen(files[i]) + 1)))
+      goto failed;
+    strcpy(pl->files[i], files[i]);
+  }
+  if(!(pl->free = SDL_CreateSemaphore(2)) || !(pl->thread = SDL_CreateThread(decoder, "playlist", pl)))
+    goto failed;
+  return pl;
+ failed:
+  plDelete(pl);
+  return NULL;
+}
+
+pl_playlist_t * plLoad(const char * path, int fft_size, int nbands, int hop) {
+  FILE * f = fopen(path, "r");
+  char ligne[1024], ** noms = NULL;
+  const char * fin = strrchr(path, '/');
+  int n = 0, max = 0, dir = fin ? (int)(fin - path + 1) : 0, i;
+  pl_playlist_t * pl = NULL;
+  if(!f) {
+    fprintf(stderr, "plLoad: impossible d'ouvrir %s\n", path);
+    return NULL;
+  }
+  while(fgets(ligne, sizeof ligne, f)) {
+    char * s = ligne, * e;
+    while(*s == ' ' || *s == '\t') ++s;
+    e = s + strlen(s);
+    while(e > s && (e[-1] == '\n' || e[-1] == '\r' || e[-1] == ' ' || e[-1] == '\t')) --e;
+    *e = '\0';
+    if(!*s || *s == '#')
+      continue;
+    if(n == max) {
+      char ** p = (char **)realloc(noms, (max = max ? 2 * max : 16) * sizeof *noms);
+      if(!p)
+	break;
+      noms = p;
+    }
+    /* chemins relatifs au dossier de la liste */
+    if(!(noms[n] = (char *)malloc(dir + strlen(s) + 1)))
+      break;
+    if(*s == '/')
+      strcpy(noms[n], s);
+    else {
+      memcpy(noms[n], path, dir);
+      strcpy(noms[n] + dir, s);
+    }
+    ++n;
+  }
+  fclose(f);
+  if(n)
+    pl = plNew((const char **)noms, n, fft_size, nbands, hop);
+  else
+    fprintf(stderr, "plLoad: aucun morceau dans %s\n", path);
+  for(i = 0; i < n; ++i)
+    free(noms[i]);
+  free(noms);
+  return pl;
+}
+
+/* callBack de musique (thread audio) : copie les morceaux décodés
+ * dans \a stream, passe au suivant sans blanc, silence s'il n'est pas
+ * prêt. Ni attente ni allocation. */
+static void mix(void * udata, Uint8 * stream, int len) {
+  pl_playlist_t * pl = (pl_playlist_t *)udata;
+  int16_t * out = (int16_t *)stream;
+  int ch = pl->channels, frames = len / (2 * ch), done = 0;
+  /* caler l'horloge sur celle du post-mixage, qui a déjà compté les
+   * blocs précédents et comptera celui-ci après nous */
+  if(pl->clock) {
+    pl->mixed = *pl->clock;
+    pl->clock = NULL;
+  }
+  while(done < frames) {
+    pl_slot_t * s = pl->used ? &pl->slots[(pl->used - 1) & 1] : NULL;
+    Uint32 m;
+    if(!s || pl->pos >= s->frames) {
+      pl_slot_t * t = &pl->slots[pl->used & 1];
+      int k;
+      if(!SDL_AtomicGet(&t->ready)) {
+	/* silence faute de décodage, sauf au tout début et à la fin */
+	if(s && pl->cur < pl->n - 1 && !SDL_AtomicGet(&pl->done))
+	  pl->underruns += frames - done;
+	break;
+      }
+      /* rendre l'emplacement du morceau fini au thread de décodage */
+      if(s) {
+	SDL_AtomicSet(&s->ready, 0);
+	SDL_SemPost(pl->free);
+      }
+      /* les morceaux sautés commencent et finissent ici */
+      for(k = pl->cur + 1; k <= t->track; ++k)
+	pl->starts[k] = pl->mixed + done;
+      pl->cur = t->track;
+      pl->pos = 0;
+      ++pl->used;
+      SDL_AtomicSet(&pl->started, pl->cur + 1);
+      continue;
+    }
+    m = s->frames - pl->pos;
+    if(m > (Uint32)(frames - done))
+      m = frames - done;
+    memcpy(out + (size_t)done * ch, s->pcm + (size_t)pl->pos * ch, (size_t)m * ch * sizeof *out);
+    done += m;
+    pl->pos += m;
+  }
+  if(done < frames)
+    memset(out + (size_t)done * ch, 0, (size_t)(frames - done) * ch * sizeof *out);
+  pl->mixed += frames;
+}
+
+void plStart(pl_playlist_t * pl, const uint64_t * clock) {
+  pl->clock = clock;
+  Mix_HookMusic(mix, pl);
+}
+
+int plTrack(pl_playlist_t * pl, double t, double * local) {
+  int k = SDL_AtomicGet(&pl->started) - 1;
+  double pos = t * pl->rate;
+  while(k >= 0 && (double)pl->starts[k] > pos)
+    --k;
+  if(local)
+    *local = k >= 0 ? t - pl->starts[k] / (double)pl->rate : 0.0;
+  return k;
+}
+
+fc_cache_t * plFeatures(pl_playlist_t * pl, int track) {
+  if(track < 0 || track >= pl->n)
+    return NULL;
+  /* le morceau track - 1 peut encore être affiché (latence) ; les
+   * précédents sont finis depuis longtemps */
+  while(pl->released < track - 1) {
+    fcDelete((fc_cache_t *)SDL_AtomicSetPtr((void **)&pl->fc[pl->released], NULL));
+    ++pl->released;
+  }
+  return (fc_cache_t *)SDL_AtomicGetPtr((void **)&pl->fc[track]);
+}
+
+const char * plName(pl_playlist_t * pl, int track) {
+  return track >= 0 && track < pl->n ? pl->files[track] : "";
+}
+
+int plCount(pl_playlist_t * pl) {
+  return pl->n;
+}
+
+uint64_t plUnderruns(pl_playlist_t * pl) {
+  return pl->underruns;
+}
+
+void plDelete(pl_playlist_t * pl) {
+  int i;
+  if(!pl) return;
+  /* plus de callBack après ce retour (verrou audio de SDL_mixer) */
+  Mix_HookMusic(NULL, NULL);
+  if(pl->thread) {
+    SDL_AtomicSet(&pl->quit, 1);
+    SDL_SemPost(pl->free);
+    SDL_WaitThread(pl->thread, NULL);
+  }
+  if(pl->free)
+    SDL_DestroySemaphore(pl->free);
+  for(i = 0; i < 2; ++i)
+    if(pl->slots[i].chunk)
+      Mix_FreeChunk(pl->slots[i].chunk);
+  for(i = 0; pl->files && i < pl->n; ++i)
+    free(pl->files[i]);
+  for(i = 0; pl->fc && i < pl->n; ++i)
+    fcDelete(pl->fc[i]);
+  free(pl->files);
+  free(pl->fc);
+  free(pl->starts);
+  free(pl);
+}
@@ -0,0 +1,60 @@
+/*!\file playlist.h
+ *
+ * \brief lecture enchaînée (sans blanc) d'une liste de morceaux.
+ *
+ * Un thread de décodage décode le morceau suivant, au format du
+ * périphérique (Mix_LoadWAV), dans l'un de deux emplacements pendant
+ * que l'autre est joué, puis en fait la pré-analyse
+ * (feature_cache.h). Le morceau décodé est lu tel quel, sans copie ;
+ * il est libéré quand son emplacement resert, au plus deux morceaux
+ * décodés sont donc en mémoire. La callBack de musique
+ * (Mix_HookMusic) passe d'un emplacement à l'autre au milieu d'un bloc,
+ * sans attente ni allocation : un morceau pas encore décodé donne du
+ * silence (compté), jamais une attente du thread audio.
+ *
+ * Les positions sont exprimées sur l'horloge du flux (secondes
+ * mixées depuis l'installation de la callBack de post-mixage), celle
+ * que compte cette callBack.
+ */
+#ifndef _PLAYLIST_H
+#define _PLAYLIST_H
+
+#include "feature_cache.h"
+
+typedef struct pl_playlist_t pl_playlist_t;
+
+/*!\brief crée une liste des \a n fichiers \a files et commence à
+ * décoder les deux premiers ; la pré-analyse utilise une FFT de \a
+ * fft_size points, \a nbands bandes et un pas de \a hop échantillons
+ * (aucune si \a fft_size vaut 0). SDL_mixer doit être ouvert.
+ * Retourne NULL en cas d'échec. */
+extern pl_playlist_t * plNew(const char ** files, int n, int fft_size, int nbands, int hop);
+/*!\brief comme plNew pour les morceaux de la liste \a path (un
+ * chemin par ligne, relatif au dossier de la liste, lignes vides et
+ * commençant par # ignorées, comme un .m3u). */
+extern pl_playlist_t * plLoad(const char * path, int fft_size, int nbands, int hop);
+/*!\brief installe la callBack de musique : la lecture commence dès
+ * que le premier morceau est décodé. \a clock est le compteur de
+ * trames de la callBack de post-mixage (thread audio) : SDL_mixer
+ * appelle la musique avant le post-mixage dans chaque bloc, la
+ * première lecture de \a clock donne donc la position exacte du flux,
+ * quel que soit l'ordre d'installation des deux callBacks. */
+extern void            plStart(pl_playlist_t * pl, const uint64_t * clock);
+/*!\brief morceau joué à l'instant \a t du flux et, dans \a local,
+ * la position dans ce morceau ; -1 avant le premier. */
+extern int             plTrack(pl_playlist_t * pl, double t, double * local);
+/*!\brief pré-analyse du morceau \a track, NULL si elle n'est pas
+ * encore faite (ou a échoué). Celles des morceaux antérieurs à \a
+ * track - 1 sont libérées : thread de rendu seulement. */
+extern fc_cache_t *    plFeatures(pl_playlist_t * pl, int track);
+/*!\brief nom du fichier du morceau \a track. */
+extern const char *    plName(pl_playlist_t * pl, int track);
+/*!\brief nombre de morceaux. */
+extern int             plCount(pl_playlist_t * pl);
+/*!\brief trames de silence joué faute de morceau suivant décodé à
+ * temps. */
+extern uint64_t        plUnderruns(pl_playlist_t * pl);
+/*!\brief retire la callBack, arrête le thread et libère tout. */
+extern void            plDelete(pl_playlist_t * pl);
+
+#endif
@@ -0,0 +1,325 @@
+/*!\file profiler.cpp
+ *
+ * \brief profileur intégré. Voir profiler.h.
+ *
+ * Chaque thread qui profile reçoit au premier appel un des
+ * PF_MAX_THREADS anneaux alloués par pfInit ; il est seul à y écrire,
+ * l'export a lieu dans pfQuit une fois les autres threads arrêtés.
+ */
+#include "profiler.h"
+#include "workers.h"
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* threads profilés (le pool, plus rendu, audio, pré-analyse et
+ * playlist), intervalles conservés par thread, profondeur
+ * d'imbrication, mesures conservées par série */
+#define PF_MAX_THREADS (WK_MAX_THREADS + 4)
+#define PF_EVENTS      (1 << 15)
+#define PF_DEPTH       16
+#define PF_SAMPLES     (1 << 16)
+/* frames de requêtes GPU en vol et requêtes par frame */
+#define PF_GPU_FRAMES  4
+#define PF_GPU_QUERIES 32
+/* histogramme : largeur et nombre de classes (ms) */
+#define PF_BIN         0.5
+#define PF_BINS        200
+/* frames affichées en surimpression */
+#define PF_OVERLAY     120
+
+typedef struct pf_event_t pf_event_t;
+struct pf_event_t {
+  const char * name;
+  Uint64 t0, t1;
+};
+
+typedef struct pf_thread_t pf_thread_t;
+struct pf_thread_t {
+  const char * name;
+  pf_event_t * ev;
+  Uint64 count;
+  const char * open_name[PF_DEPTH];
+  Uint64 open_t0[PF_DEPTH];
+  int depth;
+};
+
+static int _actif = 0;
+static char _prefix[256];
+static Uint64 _origin = 0;
+static double _freq = 1.0;
+static pf_thread_t _threads[PF_MAX_THREADS], _gpu;
+static SDL_atomic_t _nthreads;
+static thread_local pf_thread_t * _moi = NULL;
+static float * _series[PF_SERIES];
+static Uint64 _nseries[PF_SERIES];
+static Uint64 _derniere_frame = 0, _nframes = 0;
+static GLuint _q[PF_GPU_FRAMES][2 * PF_GPU_QUERIES];
+static const char * _qname[PF_GPU_FRAMES][PF_GPU_QUERIES];
+static int _qcount[PF_GPU_FRAMES], _qslot = 0, _gpu_pret = 0, _gpu_ouvert = 0;
+/* origines communes des horloges GPU (ns) et CPU (ticks) */
+static GLint64 _gpu0 = 0;
+static Uint64 _cpu0 = 0;
+
+static pf_thread_t * moi(void) {
+  int i;
+  if(_moi)
+    return _moi;
+  if((i = SDL_AtomicAdd(&_nthreads, 1)) >= PF_MAX_THREADS) {
+    /* le premier thread de trop seulement, les suivants se taisent */
+    if(i == PF_MAX_THREADS)
+      fprintf(stderr, "Profil: plus de %d threads, les suivants ne sont pas mesures\n", PF_MAX_THREADS);
+    return NULL;
+  }
+  return _moi = &_threads[i];
+}
+
+static void ajouter(pf_thread_t * th, const char * name, Uint64 t0, Uint64 t1) {
+  pf_event_t * e = &th->ev[th->count % PF_EVENTS];
+  e->name = name;
+  e->t0 = t0;
+  e->t1 = t1;
+  ++th->count;
+}
+
+int pfInit(const char * prefix) {
+  int i;
+  if(_actif)
+    return 1;
+  for(i = 0; i < PF_MAX_THREADS; ++i)
+    if(!(_threads[i].ev = (pf_event_t *)malloc(PF_EVENTS * sizeof *_threads[i].ev)))
+      return 0;
+  if(!(_gpu.ev = (pf_event_t *)malloc(PF_EVENTS * sizeof *_gpu.ev)))
+    return 0;
+  _gpu.name = "GPU";
+  for(i = 0; i < PF_SERIES; ++i)
+    if(!(_series[i] = (float *)malloc(PF_SAMPLES * sizeof *_series[i])))
+      return 0;
+  snprintf(_prefix, sizeof _prefix, "%s", prefix);
+  SDL_AtomicSet(&_nthreads, 0);
+  _freq = (double)SDL_GetPerformanceFrequency();
+  _origin = SDL_GetPerformanceCounter();
+  _actif = 1;
+  return 1;
+}
+
+int pfActive(void) {
+  return _actif;
+}
+
+void pfThreadName(const char * name) {
+  pf_thread_t * th;
+  if(_actif && (th = moi()) && !th->name)
+    th->name = name;
+}
+
+void pfBegin(const char * name) {
+  pf_thread_t * th;
+  if(!_actif || !(th = moi()))
+    return;
+  if(th->depth < PF_DEPTH) {
+    th->open_name[th->depth] = name;
+    th->open_t0[th->depth] = SDL_GetPerformanceCounter();
+  }
+  ++th->depth;
+}
+
+double pfEnd(void) {
+  pf_thread_t * th;
+  Uint64 t;
+  if(!_actif || !(th = moi()) || th->depth <= 0)
+    return 0.0;
+  if(--th->depth >= PF_DEPTH)
+    return 0.0;
+  t = SDL_GetPerformanceCounter();
+  ajouter(th, th->open_name[th->depth], th->open_t0[th->depth], t);
+  return (t - th->open_t0[th->depth]) * 1000.0 / _freq;
+}
+
+void pfSample(int serie, double ms) {
+  if(!_actif || serie < 0 || serie >= PF_SERIES)
+    return;
+  _series[serie][_nseries[serie] % PF_SAMPLES] = (float)ms;
+  ++_nseries[serie];
+}
+
+/* relit les requêtes de la frame \a slot et les range sur l'axe CPU */
+static void resoudre(int slot) {
+  int i;
+  for(i = 0; i < _qcount[slot]; ++i) {
+    GLuint64 a = 0, b = 0;
+    glGetQueryObjectui64v(_q[slot][2 * i], GL_QUERY_RESULT, &a);
+    glGetQueryObjectui64v(_q[slot][2 * i + 1], GL_QUERY_RESULT, &b);
+    ajouter(&_gpu, _qname[slot][i],
+	    _cpu0 + (Uint64)((GLint64)(a - _gpu0) * _freq / 1e9),
+	    _cpu0 + (Uint64)((GLint64)(b - _gpu0) * _freq / 1e9));
+  }
+  _qcount[slot] = 0;
+}
+
+void pfFrame(void) {
+  Uint64 t;
+  if(!_actif)
+    return;
+  t = SDL_GetPerformanceCounter();
+  if(_derniere_frame)
+    pfSample(PF_FRAME, (t - _derniere_frame) * 1000.0 / _freq);
+  _derniere_frame = t;
+  if(!_gpu_pret) {
+    glGenQueries(sizeof _q / sizeof _q[0][0], &_q[0][0]);
+    glGetInteger64v(GL_TIMESTAMP, &_gpu0);
+    _cpu0 = SDL_GetPerformanceCounter();
+    _gpu_pret = 1;
+  }
+  /* la frame qui a utilisé ce jeu de requêtes date de PF_GPU_FRAMES
+   * frames : ses résultats sont disponibles sans attente */
+  _qslot = _nframes++ % PF_GPU_FRAMES;
+  resoudre(_qslot);
+  _gpu_ouvert = 0;
+}
+
+void pfGpuBegin(const char * name) {
+  if(!_actif || !_gpu_pret || _gpu_ouvert || _qcount[_qslot] >= PF_GPU_QUERIES)
+    return;
+  glQueryCounter(_q[_qslot][2 * _qcount[_qslot]], GL_TIMESTAMP);
+  _qname[_qslot][_qcount[_qslot]] = name;
+  _gpu_ouvert = 1;
+}
+
+void pfGpuEnd(void) {
+  if(!_gpu_ouvert)
+    return;
+  glQueryCounter(_q[_qslot][2 * _qcount[_qslot] + 1], GL_TIMESTAMP);
+  ++_qcount[_qslot];
+  _gpu_ouvert = 0;
+}
+
+void pfOverlay(int w, int h) {
+  GLfloat clear[4];
+  Uint64 n = _nseries[PF_FRAME], i, first;
+  int bw = w / (2 * PF_OVERLAY), x;
+  /* 50 ms occupent le quart de la hauteur */
+  double echelle = h / 4.0 / 50.0;
+  if(!_actif || !n)
+    return;
+  if(bw < 1) bw = 1;
+  first = n > PF_OVERLAY ? n - PF_OVERLAY : 0;
+  glGetFloatv(GL_COLOR_CLEAR_VALUE, clear);
+  glEnable(GL_SCISSOR_TEST);
+  /* une barre par frame, par glClear limité au rectangle */
+  for(i = first, x = 0; i < n; ++i, x += bw) {
+    float ms = _series[PF_FRAME][i % PF_SAMPLES];
+    int bh = (int)(ms * echelle);
+    if(bh < 1) bh = 1;
+    if(ms < 1000.0f / 60.0f + 1.0f)
+      glClearColor(0.2f, 0.9f, 0.2f, 1.0f);
+    else if(ms < 1000.0f / 30.0f + 1.0f)
+      glClearColor(0.9f, 0.9f, 0.2f, 1.0f);
+    else
+      glClearColor(0.9f, 0.2f, 0.2f, 1.0f);
+    glScissor(x, 0, bw > 1 ? bw - 1 : 1, bh);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+  /* repère à 16,7 ms */
+  glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+  glScissor(0, (int)(1000.0 / 60.0 * echelle), PF_OVERLAY * bw, 1);
+  glClear(GL_COLOR_BUFFER_BIT);
+  glDisable(GL_SCISSOR_TEST);
+  glClearColor(clear[0], clear[1], clear[2], clear[3]);
+}
+
+static int exporterTrace(const char * path) {
+  FILE * f;
+  int t, nt = SDL_AtomicGet(&_nthreads), sep = 0;
+  if(nt > PF_MAX_THREADS) nt = PF_MAX_THREADS;
+  if(!(f = fopen(path, "w")))
+    return 0;
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  /* les threads profilés puis le GPU (tid nt + 1) */
+  for(t = 0; t <= nt; ++t) {
+    pf_thread_t * th = t < nt ? &_threads[t] : &_gpu;
+    Uint64 i = th->count > PF_EVENTS ? th->count - PF_EVENTS : 0;
+    if(th->name) {
+      fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+	      sep++ ? ",\n" : "", t + 1, th->name);
+    }
+    for(; i < th->count; ++i) {
+      const pf_event_t * e = &th->ev[i % PF_EVENTS];
+      fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+	      sep++ ? ",\n" : "", e->name, t + 1,
+	      ((double)e->t0 - (double)_origin) * 1e6 / _freq, ((double)e->t1 - (double)e->t0) * 1e6 / _freq);
+    }
+  }
+  fprintf(f, "\n]}\n");
+  return !fclose(f);
+}
+
+static int comparer(const void * a, const void * b) {
+  float x = *(const float *)a, y = *(const float *)b;
+  return (x > y) - (x < y);
+}
+
+static int exporterHistogramme(const char * path) {
+  static const char * noms[PF_SERIES] = { "frame", "callback", "lag" };
+  static unsigned hist[PF_SERIES][PF_BINS + 1];
+  FILE * f;
+  int s, b;
+  memset(hist, 0, sizeof hist);
+  for(s = 0; s < PF_SERIES; ++s) {
+    Uint64 n = _nseries[s] < PF_SAMPLES ? _nseries[s] : PF_SAMPLES, i;
+    double somme = 0.0;
+    float * tri;
+    for(i = 0; i < n; ++i) {
+      b = (int)(_series[s][i] / PF_BIN);
+      hist[s][b < 0 ? 0 : (b > PF_BINS ? PF_BINS : b)]++;
+      somme += _series[s][i];
+    }
+    /* résumé : moyenne, médiane, 99e centile et maximum */
+    if(n && (tri = (float *)malloc(n * sizeof *tri))) {
+      memcpy(tri, _series[s], n * sizeof *tri);
+      qsort(tri, n, sizeof *tri, comparer);
+      fprintf(stderr, "Profil %-8s: %8llu mesures, moy %7.3f ms, p50 %7.3f ms, p99 %7.3f ms, max %7.3f ms\n",
+	      noms[s], (unsigned long long)n, somme / n, tri[n / 2], tri[(n * 99) / 100], tri[n - 1]);
+      free(tri);
+    }
+  }
+  if(!(f = fopen(path, "w")))
+    return 0;
+  fprintf(f, "ms,%s,%s,%s\n", noms[0], noms[1], noms[2]);
+  for(b = 0; b <= PF_BINS; ++b)
+    fprintf(f, "%s%.1f,%u,%u,%u\n", b == PF_BINS ? ">=" : "", b * PF_BIN, hist[0][b], hist[1][b], hist[2][b]);
+  return !fclose(f);
+}
+
+void pfQuit(void) {
+  char path[300];
+  int i;
+  if(!_actif)
+    return;
+  if(_gpu_pret) {
+    _gpu_ouvert = 0;
+    for(i = 0; i < PF_GPU_FRAMES; ++i)
+      resoudre(i);
+    glDeleteQueries(sizeof _q / sizeof _q[0][0], &_q[0][0]);
+    _gpu_pret = 0;
+  }
+  snprintf(path, sizeof path, "%s.json", _prefix);
+  if(!exporterTrace(path))
+    fprintf(stderr, "Profil: impossible d'ecrire %s\n", path);
+  snprintf(path, sizeof path, "%s.csv", _prefix);
+  if(!exporterHistogramme(path))
+    fprintf(stderr, "Profil: impossible d'ecrire %s\n", path);
+  _actif = 0;
+  for(i = 0; i < PF_MAX_THREADS; ++i) {
+    free(_threads[i].ev);
+    memset(&_threads[i], 0, sizeof _threads[i]);
+  }
+  free(_gpu.ev);
+  memset(&_gpu, 0, sizeof _gpu);
+  for(i = 0; i < PF_SERIES; ++i) {
+    free(_series[i]);
+    _series[i] = NULL;
+    _nseries[i] = 0;
+  }
+}
@@ -0,0 +1,58 @@
+/*!\file profiler.h
+ *
+ * \brief profileur intégré : intervalles CPU (début/fin, imbriqués)
+ * enregistrés sans verrou ni allocation dans un anneau par thread,
+ * requêtes de temps GPU (GL_TIMESTAMP) relues avec quelques frames de
+ * retard, et séries de mesures (durée de frame, durée du callback
+ * audio, délai son-image).
+ *
+ * À la fin (pfQuit), tout est exporté en trace Chrome (PREFIXE.json,
+ * à ouvrir dans chrome://tracing ou ui.perfetto.dev) et en histogramme
+ * CSV des séries (PREFIXE.csv), avec un résumé sur stderr. Inactif
+ * (et quasi gratuit) tant que pfInit n'a pas été appelée.
+ */
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <GL4D/gl4dummies.h>
+
+/*!\brief séries de mesures, en millisecondes. */
+enum {
+  PF_FRAME = 0, /*!< temps entre deux frames */
+  PF_CALLBACK,  /*!< durée du callback audio */
+  PF_LAG,       /*!< du mixage d'un bloc à la fin de la frame qui l'utilise */
+  PF_SERIES
+};
+
+/*!\brief active le profileur ; les exports porteront le préfixe \a
+ * prefix. Retourne 0 en cas d'échec d'allocation. */
+extern int    pfInit(const char * prefix);
+/*!\brief retourne 1 si le profileur est actif. */
+extern int    pfActive(void);
+/*!\brief nomme le thread appelant dans la trace (sans effet s'il
+ * l'est déjà). */
+extern void   pfThreadName(const char * name);
+/*!\brief ouvre un intervalle CPU nommé \a name (chaîne statique) sur
+ * le thread appelant. */
+extern void   pfBegin(const char * name);
+/*!\brief ferme le dernier intervalle ouvert et retourne sa durée en
+ * millisecondes (0 si inactif). */
+extern double pfEnd(void);
+/*!\brief ajoute \a ms à la série \a serie (un seul thread écrivain
+ * par série). */
+extern void   pfSample(int serie, double ms);
+/*!\brief marque le début d'une frame (thread GL) : mesure PF_FRAME
+ * et relit les requêtes GPU des frames anciennes. */
+extern void   pfFrame(void);
+/*!\brief ouvre (thread GL) un intervalle GPU nommé \a name ; les
+ * intervalles GPU ne s'imbriquent pas. */
+extern void   pfGpuBegin(const char * name);
+/*!\brief ferme l'intervalle GPU ouvert. */
+extern void   pfGpuEnd(void);
+/*!\brief dessine en surimpression (fenêtre \a w x \a h) les durées
+ * des dernières frames, repère à 16,7 ms. */
+extern void   pfOverlay(int w, int h);
+/*!\brief exporte la trace et l'histogramme puis libère tout. */
+extern void   pfQuit(void);
+
+#endif
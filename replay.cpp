@@ -0,0 +1,189 @@
+/*!\file replay.cpp
+ *
+ * \brief journal binaire des entrées du rendu. Voir replay.h.
+ */
+#include "replay.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define RP_MAGIC   "SGREPLY"
+#define RP_VERSION 3
+/* blocs au plus par frame : tout ce que l'anneau de la callBack peut
+ * contenir ; au-delà (impossible en principe) ils sont comptés perdus */
+#define RP_BLOCKS  FR_CAPACITY
+
+typedef struct rp_header_t rp_header_t;
+struct rp_header_t {
+  char     magic[8];
+  uint32_t version, rate, buffer_frames, fft_size;
+  double   latency;
+};
+
+static FILE * _f = NULL;
+static int _writing = 0, _ok = 1, _frames = 0, _dropped = 0;
+/* blocs de la frame en cours : à écrire, ou lus et pas encore rendus */
+static fr_frame_t _blocks[RP_BLOCKS];
+static int _nblocks = 0, _next = 0;
+
+static void ecrire(const void * p, size_t n) {
+  _ok = _ok && fwrite(p, 1, n, _f) == n;
+}
+
+static int lire(void * p, size_t n) {
+  return fread(p, 1, n, _f) == n;
+}
+
+/* rms[2], peak, flux, level, nombre de bandes puis les bandes */
+static void ecrireFeatures(const aa_features_t * f) {
+  uint8_t n = (uint8_t)(f->nbands > 0 ? (f->nbands < AA_MAX_BANDS ? f->nbands : AA_MAX_BANDS) : 0);
+  ecrire(f->rms, sizeof f->rms);
+  ecrire(&f->peak, sizeof f->peak);
+  ecrire(&f->flux, sizeof f->flux);
+  ecrire(&f->level, sizeof f->level);
+  ecrire(&n, sizeof n);
+  ecrire(f->bands, n * sizeof *f->bands);
+}
+
+static int lireFeatures(aa_features_t * f) {
+  uint8_t n = 0;
+  memset(f, 0, sizeof *f);
+  if(!lire(f->rms, sizeof f->rms) || !lire(&f->peak, sizeof f->peak) || !lire(&f->flux, sizeof f->flux) ||
+     !lire(&f->level, sizeof f->level) || !lire(&n, sizeof n) || n > AA_MAX_BANDS)
+    return 0;
+  f->nbands = n;
+  return lire(f->bands, n * sizeof *f->bands);
+}
+
+int rpRecord(const char * path, const rp_audio_t * audio) {
+  rp_header_t h;
+  rpClose();
+  if(!(_f = fopen(path, "wb"))) {
+    fprintf(stderr, "rpRecord: impossible de creer %s\n", path);
+    return 0;
+  }
+  memset(&h, 0, sizeof h);
+  memcpy(h.magic, RP_MAGIC, sizeof h.magic);
+  h.version = RP_VERSION;
+  h.rate = audio->rate;
+  h.buffer_frames = audio->buffer_frames;
+  h.fft_size = audio->fft_size;
+  h.latency = audio->latency;
+  _writing = 1;
+  _ok = 1;
+  ecrire(&h, sizeof h);
+  return _ok;
+}
+
+void rpBlock(const fr_frame_t * fr) {
+  if(!_writing)
+    return;
+  if(_nblocks < RP_BLOCKS)
+    _blocks[_nblocks++] = *fr;
+  else
+    ++_dropped;
+}
+
+void rpFrame(const rp_frame_t * f) {
+  uint16_t n = (uint16_t)_nblocks;
+  uint8_t sampled = (uint8_t)(f->sampled != 0);
+  int i;
+  if(!_writing)
+    return;
+  ecrire(&n, sizeof n);
+  ecrire(&f->dt, sizeof f->dt);
+  ecrire(&f->heard, sizeof f->heard);
+  ecrire(&sampled, sizeof sampled);
+  if(sampled) {
+    ecrire(&f->ahead, sizeof f->ahead);
+    ecrireFeatures(&f->f);
+  }
+  for(i = 0; i < _nblocks; ++i) {
+    ecrire(&_blocks[i].t, sizeof _blocks[i].t);
+    ecrire(&_blocks[i].duration, sizeof _blocks[i].duration);
+    ecrire(&_blocks[i].wall, sizeof _blocks[i].wall);
+    ecrireFeatures(&_blocks[i].f);
+  }
+  _nblocks = 0;
+  ++_frames;
+}
+
+int rpReplay(const char * path, rp_audio_t * audio) {
+  rp_header_t h;
+  rpClose();
+  if(!(_f = fopen(path, "rb"))) {
+    fprintf(stderr, "rpReplay: impossible d'ouvrir %s\n", path);
+    return 0;
+  }
+  if(!lire(&h, sizeof h) || memcmp(h.magic, RP_MAGIC, sizeof h.magic) || h.version != RP_VERSION) {
+    fprintf(stderr, "rpReplay: %s n'est pas un journal de cette version\n", path);
+    rpClose();
+    return 0;
+  }
+  audio->rate = h.rate;
+  audio->buffer_frames = h.buffer_frames;
+  audio->fft_size = h.fft_size;
+  audio->latency = h.latency;
+  return 1;
+}
+
+int rpNextFrame(rp_frame_t * f) {
+  uint16_t n;
+  uint8_t sampled;
+  int i;
+  _nblocks = _next = 0;
+  if(!_f || _writing)
+    return 0;
+  if(!lire(&n, sizeof n) || !lire(&f->dt, sizeof f->dt) || !lire(&f->heard, sizeof f->heard) ||
+     !lire(&sampled, sizeof sampled))
+    return 0;
+  /* plus de blocs qu'une frame ne peut en avoir : journal corrompu */
+  if(n > RP_BLOCKS) {
+    fprintf(stderr, "rpNextFrame: frame %d corrompue (%d blocs)\n", _frames, n);
+    return 0;
+  }
+  f->sampled = sampled;
+  f->ahead = -1.0;
+  if(sampled) {
+    if(!lire(&f->ahead, sizeof f->ahead) || !lireFeatures(&f->f))
+      return 0;
+  } else
+    memset(&f->f, 0, sizeof f->f);
+  for(i = 0; i < n; ++i) {
+    fr_frame_t * b = &_blocks[i];
+    if(!lire(&b->t, sizeof b->t) || !lire(&b->duration, sizeof b->duration) || !lire(&b->wall, sizeof b->wall) ||
+       !lireFeatures(&b->f))
+      return 0;
+  }
+  _nblocks = n;
+  ++_frames;
+  return 1;
+}
+
+int rpNextBlock(fr_frame_t * fr) {
+  if(_next >= _nblocks)
+    return 0;
+  *fr = _blocks[_next++];
+  return 1;
+}
+
+int rpFrames(void) {
+  return _frames;
+}
+
+int rpDropped(void) {
+  return _dropped;
+}
+
+int rpClose(void) {
+  int ok = _ok;
+  if(_f) {
+    if(_writing)
+      ok = fflush(_f) == 0 && ok;
+    fclose(_f);
+    _f = NULL;
+  }
+  _writing = _nblocks = _next = _frames = _dropped = 0;
+  _ok = 1;
+  return ok;
+}
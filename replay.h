@@ -0,0 +1,73 @@
+/*!\file replay.h
+ *
+ * \brief enregistrement et rejeu des entrées du rendu, pour des
+ * mesures de performance reproductibles.
+ *
+ * L'enregistrement écrit, frame par frame, dans un journal binaire
+ * compact : le pas de temps de la frame, la position de lecture
+ * (instant du flux entendu, qui intègre la latence courante, même
+ * changée par une calibration), les caractéristiques échantillonnées dans une
+ * pré-analyse (s'il y en avait une) puis les blocs audio analysés
+ * reçus pendant la frame. Le rejeu relit ces frames à la place de
+ * l'horloge, de l'anneau de la callBack et des pré-analyses : aucun
+ * périphérique audio n'est ouvert et draw reçoit exactement les mêmes
+ * entrées.
+ *
+ * Format : un rp_header_t puis, par frame, un enregistrement de frame
+ * suivi de ses blocs ; les caractéristiques ne portent que leurs
+ * bandes renseignées. Les nombres sont dans l'ordre d'octets de la
+ * machine.
+ */
+#ifndef _REPLAY_H
+#define _REPLAY_H
+
+#include "feature_ring.h"
+
+/*!\brief paramètres de la chaîne audio de l'enregistrement, à
+ * réutiliser au rejeu. */
+typedef struct rp_audio_t rp_audio_t;
+struct rp_audio_t {
+  int rate, buffer_frames, fft_size;
+  double latency;
+};
+
+/*!\brief entrées d'une frame. */
+typedef struct rp_frame_t rp_frame_t;
+struct rp_frame_t {
+  /*!\brief pas de temps et instant du flux entendu à l'affichage de
+   * la frame, en secondes. */
+  double dt, heard;
+  /*!\brief 1 si \a f et \a ahead viennent d'une pré-analyse. */
+  int sampled;
+  /*!\brief temps avant la prochaine attaque connue (-1 si aucune). */
+  double ahead;
+  aa_features_t f;
+};
+
+/*!\brief crée le journal \a path pour la chaîne \a audio. Retourne 0
+ * en cas d'échec. */
+extern int  rpRecord(const char * path, const rp_audio_t * audio);
+/*!\brief ajoute à la frame en cours le bloc \a fr reçu de la
+ * callBack. */
+extern void rpBlock(const fr_frame_t * fr);
+/*!\brief écrit la frame \a f et ses blocs. */
+extern void rpFrame(const rp_frame_t * f);
+/*!\brief ouvre le journal \a path pour le rejeu et remplit \a audio.
+ * Retourne 0 s'il est illisible ou d'une autre version. */
+extern int  rpReplay(const char * path, rp_audio_t * audio);
+/*!\brief lit la frame suivante dans \a f. Retourne 0 à la fin du
+ * journal (ou s'il est tronqué). */
+extern int  rpNextFrame(rp_frame_t * f);
+/*!\brief donne dans \a fr le bloc suivant de la frame lue. Retourne 0
+ * quand elle n'en a plus. */
+extern int  rpNextBlock(fr_frame_t * fr);
+/*!\brief nombre de frames écrites ou lues. */
+extern int  rpFrames(void);
+/*!\brief nombre de blocs non enregistrés, faute de place dans la
+ * frame. */
+extern int  rpDropped(void);
+/*!\brief termine l'écriture (ou la lecture) et ferme le journal.
+ * Retourne 0 si une écriture a échoué. */
+extern int  rpClose(void);
+
+#endif
@@ -0,0 +1,265 @@
+/*!\file shader_variants.cpp
+ *
+ * \brief variantes de shaders et cache de programmes binaires. Voir
+ * shader_variants.h.
+ *
+ * Format du fichier de cache : un sv_header_t puis le binaire rendu
+ * par glGetProgramBinary, valable pour ce seul pilote.
+ */
+#include "shader_variants.h"
+#include "mapped_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SV_MAGIC     "SGPROG\0"
+#define SV_VERSION   1
+#define SV_CACHE_DIR "cache"
+
+typedef struct sv_header_t sv_header_t;
+struct sv_header_t {
+  char     magic[8];
+  uint32_t version, format;
+  uint64_t key;
+  uint32_t length, reserved;
+};
+
+typedef struct sv_variant_t sv_variant_t;
+struct sv_variant_t {
+  GLuint id;
+  int failed;
+};
+
+static char * _vs = NULL, * _fs = NULL;
+static sv_setup_t _setup = NULL;
+static sv_variant_t _variants[SV_VARIANTS];
+static int _hits = 0;
+
+static char * lire(const char * path) {
+  FILE * f = fopen(path, "rb");
+  char * s = NULL;
+  long n;
+  if(!f)
+    return NULL;
+  if(fseek(f, 0, SEEK_END) == 0 && (n = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0 &&
+     (s = (char *)malloc(n + 1))) {
+    if(fread(s, 1, n, f) != (size_t)n) {
+      free(s);
+      s = NULL;
+    } else
+      s[n] = '\0';
+  }
+  fclose(f);
+  return s;
+}
+
+int svInit(const char * vs, const char * fs, sv_setup_t setup) {
+  svQuit();
+  if(!(_vs = lire(vs)) || !(_fs = lire(fs))) {
+    fprintf(stderr, "svInit: impossible de lire %s ou %s\n", vs, fs);
+    svQuit();
+    return 0;
+  }
+  _setup = setup;
+  return 1;
+}
+
+/* le binaire des programmes n'est utilisable que si le pilote propose
+ * au moins un format (GL 4.1 ou ARB_get_program_binary) */
+static int binairesDisponibles(void) {
+  GLint n = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n);
+  return n > 0;
+}
+
+/* empreinte du pilote, des sources et des options */
+static uint64_t cle(unsigned flags) {
+  const char * s[3] = { (const char *)glGetString(GL_VENDOR), (const char *)glGetString(GL_RENDERER),
+			(const char *)glGetString(GL_VERSION) };
+  uint64_t h = MF_HASH_SEED;
+  int i;
+  for(i = 0; i < 3; ++i)
+    if(s[i])
+      h = mfHash(s[i], strlen(s[i]) + 1, h);
+  h = mfHash(&flags, sizeof flags, h);
+  h = mfHash(_vs, strlen(_vs) + 1, h);
+  return mfHash(_fs, strlen(_fs) + 1, h);
+}
+
+static GLuint charger(const char * path, uint64_t key) {
+  mf_file_t mf;
+  const sv_header_t * h;
+  GLuint p = 0;
+  GLint ok = GL_FALSE;
+  if(!mfOpen(path, &mf))
+    return 0;
+  h = (const sv_header_t *)mf.data;
+  if(mf.size >= sizeof *h && !memcmp(h->magic, SV_MAGIC, sizeof h->magic) && h->version == SV_VERSION &&
+     h->key == key && mf.size == sizeof *h + h->length) {
+    p = glCreateProgram();
+    glProgramBinary(p, h->format, (const char *)mf.data + sizeof *h, h->length);
+    /* un binaire refusé (pilote mis à jour) n'est pas une erreur */
+    glGetProgramiv(p, GL_LINK_STATUS, &ok);
+    if(!ok) {
+      glDeleteProgram(p);
+      p = 0;
+    }
+  }
+  mfClose(&mf);
+  return p;
+}
+
+static void enregistrer(const char * path, GLuint p, uint64_t key) {
+  GLint len = 0;
+  GLenum format = 0;
+  sv_header_t * h;
+  glGetProgramiv(p, GL_PROGRAM_BINARY_LENGTH, &len);
+  if(len <= 0 || !(h = (sv_header_t *)malloc(sizeof *h + len)))
+    return;
+  memset(h, 0, sizeof *h);
+  memcpy(h->magic, SV_MAGIC, sizeof h->magic);
+  h->version = SV_VERSION;
+  h->key = key;
+  glGetProgramBinary(p, len, &len, &format, (char *)h + sizeof *h);
+  h->format = format;
+  h->length = len;
+  /* échec d'écriture sans conséquence : on recompilera */
+  mfWriteAtomic(path, h, sizeof *h + len);
+  free(h);
+}
+
+/* compile \a src avec les #define de \a flags insérés après #version */
+static GLuint compiler(GLenum type, const char * src, unsigned flags) {
+  char defs[256], log[1024];
+  const char * parts[3];
+  GLint lens[3], ok = GL_FALSE;
+  GLuint s;
+  int n = 0;
+  const char * fin = !strncmp(src, "#version", 8) ? strchr(src, '\n') : NULL;
+  lens[0] = fin ? (GLint)(fin - src + 1) : 0;
+  parts[0] = src;
+  if(flags & SV_TEXTURE)    n += snprintf(defs + n, sizeof defs - n, "#define USE_TEXTURE 1\n");
+  if(flags & SV_NORMAL_MAP) n += snprintf(defs + n, sizeof defs - n, "#define USE_NORMAL_MAP 1\n");
+  if(flags & SV_INSTANCING) n += snprintf(defs + n, sizeof defs - n, "#define USE_INSTANCING 1\n");
+  if(flags & SV_CLUSTERED)  n += snprintf(defs + n, sizeof defs - n, "#define USE_CLUSTERED 1\n");
+  /* numéros de ligne des erreurs inchangés */
+  n += snprintf(defs + n, sizeof defs - n, "#line %d\n", fin ? 2 : 1);
+  parts[1] = defs;
+  lens[1] = n;
+  parts[2] = src + lens[0];
+  lens[2] = (GLint)strlen(parts[2]);
+  s = glCreateShader(type);
+  glShaderSource(s, 3, parts, lens);
+  glCompileShader(s);
+  glGetShaderiv(s, GL_COMPILE_STATUS, &ok);
+  if(!ok) {
+    glGetShaderInfoLog(s, sizeof log, NULL, log);
+    fprintf(stderr, "svProgram: variante %u, %s shader :\n%s\n", flags,
+	    type == GL_VERTEX_SHADER ? "vertex" : "fragment", log);
+    glDeleteShader(s);
+    return 0;
+  }
+  return s;
+}
+
+static GLuint construire(unsigned flags, int binaire) {
+  char log[1024];
+  GLuint vs, fs, p;
+  GLint ok = GL_FALSE;
+  if(!(vs = compiler(GL_VERTEX_SHADER, _vs, flags)))
+    return 0;
+  if(!(fs = compiler(GL_FRAGMENT_SHADER, _fs, flags))) {
+    glDeleteShader(vs);
+    return 0;
+  }
+  p = glCreateProgram();
+  if(binaire)
+    glProgramParameteri(p, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  glAttachShader(p, vs);
+  glAttachShader(p, fs);
+  glLinkProgram(p);
+  glDetachShader(p, vs);
+  glDetachShader(p, fs);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+  glGetProgramiv(p, GL_LINK_STATUS, &ok);
+  if(!ok) {
+    glGetProgramInfoLog(p, sizeof log, NULL, log);
+    fprintf(stderr, "svProgram: variante %u, edition de liens :\n%s\n", flags, log);
+    glDeleteProgram(p);
+    return 0;
+  }
+  return p;
+}
+
+GLuint svProgram(unsigned flags) {
+  sv_variant_t * v;
+  char path[256];
+  uint64_t key;
+  int binaire;
+  if(flags >= SV_VARIANTS || !_vs)
+    return 0;
+  v = &_variants[flags];
+  if(v->id || v->failed)
+    return v->id;
+  binaire = binairesDisponibles();
+  key = cle(flags);
+  snprintf(path, sizeof path, SV_CACHE_DIR "/%016llx.prog", (unsigned long long)key);
+  if(binaire && (v->id = charger(path, key)))
+    ++_hits;
+  else if((v->id = construire(flags, binaire)) && binaire)
+    enregistrer(path, v->id, key);
+  if(!v->id) {
+    v->failed = 1;
+    return 0;
+  }
+  glUseProgram(v->id);
+  if(_setup)
+    _setup(v->id);
+  glUseProgram(0);
+  return v->id;
+}
+
+GLuint svUse(unsigned flags) {
+  GLuint p = svProgram(flags);
+  glUseProgram(p);
+  return p;
+}
+
+void svNormalMatrix(const GLfloat * view, const GLfloat * model, GLfloat * n) {
+  GLfloat a[3][3], det;
+  int i, j;
+  for(i = 0; i < 3; ++i)
+    for(j = 0; j < 3; ++j)
+      a[i][j] = view[4 * i] * model[j] + view[4 * i + 1] * model[4 + j] + view[4 * i + 2] * model[8 + j];
+  n[0] = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+  n[1] = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+  n[2] = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+  n[3] = a[0][2] * a[2][1] - a[0][1] * a[2][2];
+  n[4] = a[0][0] * a[2][2] - a[0][2] * a[2][0];
+  n[5] = a[0][1] * a[2][0] - a[0][0] * a[2][1];
+  n[6] = a[0][1] * a[1][2] - a[0][2] * a[1][1];
+  n[7] = a[0][2] * a[1][0] - a[0][0] * a[1][2];
+  n[8] = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+  /* inverse transposée = comatrice / déterminant : seul son signe compte */
+  det = a[0][0] * n[0] + a[0][1] * n[1] + a[0][2] * n[2];
+  if(det < 0.0f)
+    for(i = 0; i < 9; ++i)
+      n[i] = -n[i];
+}
+
+int svCacheHits(void) {
+  return _hits;
+}
+
+void svQuit(void) {
+  int i;
+  for(i = 0; i < SV_VARIANTS; ++i)
+    if(_variants[i].id)
+      glDeleteProgram(_variants[i].id);
+  memset(_variants, 0, sizeof _variants);
+  _hits = 0;
+  free(_vs);
+  free(_fs);
+  _vs = _fs = NULL;
+}
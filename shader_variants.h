@@ -0,0 +1,56 @@
+/*!\file shader_variants.h
+ *
+ * \brief variantes (permutations) d'un couple de shaders : chaque
+ * combinaison d'options est compilée avec ses #define (USE_TEXTURE,
+ * USE_NORMAL_MAP, USE_INSTANCING, USE_CLUSTERED) insérés après la
+ * ligne #version, pour que les shaders n'aient plus de branchement à
+ * l'exécution.
+ *
+ * gl4duCreateProgram ne permettant pas d'injecter des #define, la
+ * compilation est faite ici ; les programmes liés sont enregistrés
+ * (glGetProgramBinary) dans le dossier cache/, identifiés par
+ * l'empreinte du pilote (vendeur, renderer, version) et des sources,
+ * et rechargés sans compilation GLSL aux démarrages suivants.
+ *
+ * La matrice des normales est calculée sur le CPU (svNormalMatrix)
+ * plutôt que par sommet dans le vertex shader.
+ */
+#ifndef _SHADER_VARIANTS_H
+#define _SHADER_VARIANTS_H
+
+#include <GL4D/gl4dummies.h>
+
+/*!\brief options d'une variante, à combiner ; SV_PLAIN n'en a aucune. */
+enum {
+  SV_PLAIN      = 0,
+  SV_TEXTURE    = 1,
+  SV_NORMAL_MAP = 2,
+  SV_INSTANCING = 4,
+  SV_CLUSTERED  = 8,
+  SV_VARIANTS   = 16
+};
+
+/*!\brief fonction appelée une fois sur chaque programme créé (blocs
+ * d'uniformes, unités des samplers), programme en cours. */
+typedef void (*sv_setup_t)(GLuint pId);
+
+/*!\brief lit les sources \a vs et \a fs ; \a setup (peut être NULL)
+ * sera appelée sur chaque nouveau programme. Retourne 0 si une source
+ * est illisible. */
+extern int    svInit(const char * vs, const char * fs, sv_setup_t setup);
+/*!\brief retourne le programme de la variante \a flags, chargé du
+ * cache ou compilé au premier appel ; 0 en cas d'échec. */
+extern GLuint svProgram(unsigned flags);
+/*!\brief utilise (glUseProgram) la variante \a flags et la retourne. */
+extern GLuint svUse(unsigned flags);
+/*!\brief calcule dans \a n (3x3, par lignes comme les matrices GL4D)
+ * la matrice des normales de \a view x \a model (4x4, par lignes) :
+ * comatrice du bloc 3x3, soit l'inverse transposée à un facteur
+ * positif près (les normales sont renormalisées dans le shader). */
+extern void   svNormalMatrix(const GLfloat * view, const GLfloat * model, GLfloat * n);
+/*!\brief retourne le nombre de variantes chargées depuis le cache. */
+extern int    svCacheHits(void);
+/*!\brief libère les programmes et les sources. */
+extern void   svQuit(void);
+
+#endif
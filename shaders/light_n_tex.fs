@@ -1,11 +1,36 @@
 #version 330
-uniform vec4 surface_ambient_color;
-uniform vec4 light_ambient_color;
-uniform vec4 surface_diffuse_color;
-uniform vec4 light_diffuse_color;
-uniform vec4 surface_specular_color;
-uniform vec4 light_specular_color;
-uniform vec4 light_position;
+/* variantes (voir shader_variants.h) : USE_TEXTURE, USE_NORMAL_MAP,
+ * USE_INSTANCING et USE_CLUSTERED sont définies ou non à la
+ * compilation, le code de chaque fragment est donc sans branchement
+ * (hors boucle sur les lumières du cluster) */
+/* éclairage de la frame, commun à tous les objets (std140, voir
+ * ub_light_t dans uniform_blocks.h) */
+layout(std140) uniform light_block {
+  vec4 light_ambient_color;
+  vec4 light_diffuse_color;
+  vec4 light_specular_color;
+  vec4 light_position;
+  /* clusters (voir clustered_lights.h) : inverse de la taille d'une
+   * tuile en pixels, facteur et décalage de log(profondeur) vers la
+   * tranche ; nombre de tuiles en x et y, de tranches, de lumières */
+  vec4  cluster_scale;
+  ivec4 cluster_dims;
+};
+
+/* matériau de l'objet dessiné (std140, voir ub_material_t dans
+ * uniform_blocks.h) ; doit être identique dans le vertex shader */
+layout(std140) uniform material_block {
+  vec4  surface_ambient_color;
+  vec4  surface_diffuse_color;
+  vec4  surface_specular_color;
+  /* facteur multiplicatif de texture */
+  float mult_tex_coord;
+  /* options du matériau ; elles choisissent la variante côté CPU et
+   * ne sont plus lues ici */
+  bool  use_texture;
+  bool  use_nm_texture;
+  bool  use_instancing;
+};
 
 uniform mat4 view;/* la matrice de "la caméra" */
 
@@ -17,13 +42,14 @@ uniform sampler2D my_texture;
  * éventuellement utiliser. */
 uniform sampler2D my_nm_texture;
 
-/* variable indiquant que je souhaite (ou non) utiliser une texture
- * dans mon rendu. */
-uniform bool use_texture;
-
-/* variable indiquant que je souhaite (ou non) utiliser une texture
- * pour perturber la map des normales. */
-uniform bool use_nm_texture;
+#ifdef USE_CLUSTERED
+/* lumières ponctuelles en coordonnées de vue (deux texels chacune :
+ * position et portée, couleur x intensité), début et nombre d'indices
+ * de chaque cluster, indices des lumières */
+uniform samplerBuffer  cl_lights;
+uniform usamplerBuffer cl_grid;
+uniform usamplerBuffer cl_indices;
+#endif
 
 
 in  vec3 modnormal;
@@ -31,6 +57,10 @@ in  vec4 modpos;
 /* récupérer la sortie du vertex shader transmettant la coordonnée de
  * texture (uv-map) depuis le vertex shader vers le fragment shader */
 in  vec2 vsoTexCoord;
+#ifdef USE_INSTANCING
+/* couleur de l'instance */
+in  vec4 vsoColor;
+#endif
 
 out vec4 fragColor;
 
@@ -42,23 +72,57 @@ void main() {
 
   /* gestion éventuelle d'une normal map, ici pour le plan horizontal */
   vec3 normal = modnormal;
-  if(use_nm_texture) {
-    normal = vec3(normal.x + texture(my_nm_texture, vsoTexCoord).r, normal.y, normal.z + texture(my_nm_texture, vsoTexCoord).g);
-    normal.xyz += 0.02 * (2.0 * texture(my_nm_texture, vsoTexCoord).rbg - vec3(1.0));
-    normal = normalize(normal);
-  }
+#ifdef USE_NORMAL_MAP
+  /* une seule lecture de la normal map */
+  vec3 nm = texture(my_nm_texture, vsoTexCoord).rgb;
+  normal = vec3(normal.x + nm.r, normal.y, normal.z + nm.g);
+  normal.xyz += 0.02 * (2.0 * nm.rbg - vec3(1.0));
+  normal = normalize(normal);
+#endif
   intensite_lumiere_diffuse = clamp(dot(normal, -light_direction), 0.0, 1.0);
   vec4 ambient_color = light_ambient_color * surface_ambient_color;
   vec4 diffuse_color = intensite_lumiere_diffuse * light_diffuse_color * surface_diffuse_color;
+#ifdef USE_INSTANCING
+  ambient_color *= vsoColor;
+  diffuse_color *= vsoColor;
+#endif
   vec3 R = normalize(reflect(light_direction, normal)); 
   vec3 V = vec3(0.0, 0.0, -1.0);
   float intensite_lumiere_speculaire = pow(clamp(dot(R, -V), 0.0, 1.0), 10.0);
   vec4 specular_color = intensite_lumiere_speculaire * light_specular_color * surface_specular_color;
   fragColor = 0.2 * ambient_color + 0.8 * diffuse_color + specular_color;
+#ifdef USE_CLUSTERED
+  {
+    /* cluster du fragment : tuile d'écran et tranche de profondeur */
+    ivec3 c = ivec3(gl_FragCoord.xy * cluster_scale.xy, log(-modpos.z) * cluster_scale.z + cluster_scale.w);
+    c = clamp(c, ivec3(0), cluster_dims.xyz - ivec3(1));
+    uvec2 g = texelFetch(cl_grid, (c.z * cluster_dims.y + c.y) * cluster_dims.x + c.x).rg;
+    vec3 V2 = normalize(-modpos.xyz), diffuse = vec3(0.0), specular = vec3(0.0);
+    for(uint k = 0u; k < g.y; ++k) {
+      int i = int(texelFetch(cl_indices, int(g.x + k)).r);
+      vec4 p = texelFetch(cl_lights, 2 * i);
+      vec3 couleur = texelFetch(cl_lights, 2 * i + 1).rgb;
+      vec3 L = p.xyz - modpos.xyz;
+      float d = length(L);
+      /* atténuation qui s'annule à la portée p.w */
+      float att = clamp(1.0 - d / p.w, 0.0, 1.0);
+      L /= max(d, 1e-4);
+      att *= att;
+      diffuse += att * clamp(dot(normal, L), 0.0, 1.0) * couleur;
+      specular += att * pow(clamp(dot(reflect(-L, normal), V2), 0.0, 1.0), 10.0) * couleur;
+    }
+    vec3 ajout = diffuse * surface_diffuse_color.rgb;
+#ifdef USE_INSTANCING
+    ajout *= vsoColor.rgb;
+#endif
+    fragColor.rgb += ajout + specular * surface_specular_color.rgb;
+  }
+#endif
   /* si je demande à utiliser une texture, multiplier la couleur
      calculée par cette couleur extraite de la texture en utilisant le
      sampler2D (unité de texture 2D) et en piochant à la coordonnée de
      texture récupérée depuis le vertex shader. */
-  if(use_texture)
-    fragColor *= texture(my_texture, vsoTexCoord);
+#ifdef USE_TEXTURE
+  fragColor *= texture(my_texture, vsoTexCoord);
+#endif
 }
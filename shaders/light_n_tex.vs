@@ -1,25 +1,73 @@
 #version 330
+/* variantes (voir shader_variants.h) : USE_TEXTURE, USE_NORMAL_MAP,
+ * USE_INSTANCING et USE_CLUSTERED sont définies ou non à la
+ * compilation */
 
 /* Ces entrées proviennent du CPU et sont attendues à l'emplacement 0, 1 et 2 */
 layout(location = 0) in vec3 pos; /* position du sommet dans l'espace objet */
 layout(location = 1) in vec3 normal; /* normale au sommet dans l'espace objet */
 layout(location = 2) in vec2 texCoord; /* coordonnée de texture 2D du sommet */
+#ifdef USE_INSTANCING
+/* attributs d'instance (mode foule, voir crowd.cpp) : matrice de
+ * modélisation (locations 3 à 6) et couleur */
+layout(location = 3) in mat4 inst_model;
+layout(location = 7) in vec4 inst_color;
+#else
+/* transformations de l'objet (voir ub_object_t dans uniform_blocks.h),
+ * par lignes comme les matrices GL4D : la matrice modélisation-monde et
+ * celle des normales de view * model, calculées sur le CPU, puis
+ * l'amplitude du déplacement par le spectre */
+layout(std140, row_major) uniform object_block {
+  mat4 model;
+  mat3 normal_matrix;
+  float displacement;
+};
+/* spectre par bandes de la frame, dans [0, 1] (voir
+ * spectrum_texture.h) */
+uniform sampler1D spectrum;
+#endif
 
 uniform mat4 proj; /* la matrice de projection */
-uniform mat4 model; /* la matrice modélisation-monde */
 uniform mat4 view;/* la matrice de "la caméra" */
-/* facteur multiplicatif de texture */
-uniform float mult_tex_coord;
+/* matériau de l'objet dessiné, identique au bloc du fragment shader
+ * (seul mult_tex_coord, facteur multiplicatif de texture, sert ici) */
+layout(std140) uniform material_block {
+  vec4  surface_ambient_color;
+  vec4  surface_diffuse_color;
+  vec4  surface_specular_color;
+  float mult_tex_coord;
+  bool  use_texture;
+  bool  use_nm_texture;
+  bool  use_instancing;
+};
 
 out vec3 modnormal;
 out vec4 modpos;
 /* nouvelle sortie, je transmets la coordonnée de texture (uv-map)
  * depuis le vertex shader vers le fragment shader */
 out vec2 vsoTexCoord;
+#ifdef USE_INSTANCING
+/* couleur de l'instance, multipliée aux couleurs de surface */
+out vec4 vsoColor;
+#endif
 
 void main() {
-  modnormal = normalize((transpose(inverse(view * model)) * vec4(normal, 0.0)).xyz);
-  modpos = view * model * vec4(pos, 1.0);
+#ifdef USE_INSTANCING
+  /* une instance n'est que rotation et échelle uniforme : le bloc 3x3
+   * suffit pour les normales */
+  mat4 MV = view * inst_model;
+  modnormal = normalize(mat3(MV) * normal);
+  vsoColor = inst_color;
+  vec3 p = pos;
+#else
+  mat4 MV = view * model;
+  modnormal = normalize(normal_matrix * normal);
+  /* gonflement radial selon la bande correspondant à la hauteur du
+   * sommet (graves en bas, aigus en haut) ; il ne dépend que de la
+   * position, les sommets confondus restent donc confondus */
+  vec3 p = pos * (1.0 + displacement * texture(spectrum, 0.5 + 0.5 * pos.y).r);
+#endif
+  modpos = MV * vec4(p, 1.0);
   gl_Position = proj * modpos;
   vsoTexCoord = mult_tex_coord * texCoord;
 }
@@ -0,0 +1,66 @@
+/*!\file spectrum_texture.cpp
+ *
+ * \brief texture 1D du spectre alimentée par un PBO
+ * persistant. Voir spectrum_texture.h.
+ */
+#include "spectrum_texture.h"
+#include "buffer_ring.h"
+#include <stdlib.h>
+#include <string.h>
+
+static GLuint _tex = 0;
+static int _nbands = 0;
+/* PBO persistant, buffer nul sans buffer persistant */
+static br_ring_t _pbo;
+
+int stInit(int nbands) {
+  GLfloat * zeros;
+  stQuit();
+  if(nbands <= 0 || !(zeros = (GLfloat *)calloc(nbands, sizeof *zeros)))
+    return 0;
+  _nbands = nbands;
+  glGenTextures(1, &_tex);
+  glBindTexture(GL_TEXTURE_1D, _tex);
+  /* interpolation entre bandes voisines, pas de mipmaps */
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexImage1D(GL_TEXTURE_1D, 0, GL_R32F, nbands, 0, GL_RED, GL_FLOAT, zeros);
+  glBindTexture(GL_TEXTURE_1D, 0);
+  free(zeros);
+  /* pas de projection : repli sur le transfert direct */
+  if(brHasBufferStorage() && brInit(&_pbo, GL_PIXEL_UNPACK_BUFFER, nbands * sizeof(GLfloat)) && !_pbo.mapped)
+    brQuit(&_pbo);
+  return 1;
+}
+
+void stUpdate(const float * bands, int n) {
+  if(!_tex)
+    return;
+  if(n > _nbands)
+    n = _nbands;
+  glActiveTexture(GL_TEXTURE0 + ST_UNIT);
+  glBindTexture(GL_TEXTURE_1D, _tex);
+  if(n > 0) {
+    if(_pbo.mapped) {
+      memcpy(brBegin(&_pbo), bands, n * sizeof *bands);
+      /* la copie PBO -> texture est faite par le GPU ; la fence protège
+       * la région jusqu'à ce qu'elle soit lue */
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbo.buffer);
+      glTexSubImage1D(GL_TEXTURE_1D, 0, 0, n, GL_RED, GL_FLOAT, (const void *)brOffset(&_pbo));
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      brEnd(&_pbo);
+    } else
+      glTexSubImage1D(GL_TEXTURE_1D, 0, 0, n, GL_RED, GL_FLOAT, bands);
+  }
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void stQuit(void) {
+  brQuit(&_pbo);
+  if(_tex) {
+    glDeleteTextures(1, &_tex);
+    _tex = 0;
+  }
+  _nbands = 0;
+}
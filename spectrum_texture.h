@@ -0,0 +1,31 @@
+/*!\file spectrum_texture.h
+ *
+ * \brief spectre par bandes transmis chaque frame au vertex shader
+ * dans une petite texture 1D (une bande par texel, R32F), pour que
+ * light_n_tex.vs déplace les sommets sur le GPU.
+ *
+ * Les bandes passent par un buffer de dépaquetage (PBO) persistant
+ * (GL 4.4 / ARB_buffer_storage) découpé en trois régions tournantes
+ * protégées par des fences (buffer_ring.h), comme les blocs d'uniformes : la copie
+ * vers la texture est faite par le GPU, sans attente côté CPU. Sans
+ * buffer persistant, les bandes sont transférées directement depuis la
+ * RAM.
+ */
+#ifndef _SPECTRUM_TEXTURE_H
+#define _SPECTRUM_TEXTURE_H
+
+#include <GL4D/gl4dummies.h>
+
+/*!\brief unité de texture du sampler spectrum des shaders. */
+#define ST_UNIT 2
+
+/*!\brief créé la texture de \a nbands bandes (à zéro) et son PBO.
+ * Retourne 0 en cas d'échec. */
+extern int  stInit(int nbands);
+/*!\brief transfère les \a n premières bandes \a bands (dans [0, 1])
+ * vers la texture et la lie à l'unité ST_UNIT. */
+extern void stUpdate(const float * bands, int n);
+/*!\brief libère la texture et le PBO. */
+extern void stQuit(void);
+
+#endif
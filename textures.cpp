@@ -0,0 +1,270 @@
+/*!\file textures.cpp
+ *
+ * \brief chargement asynchrone des textures et cache de mipmaps. Voir
+ * textures.h.
+ *
+ * Format du fichier de cache (boutisme natif) : un tx_header_t puis
+ * les niveaux RGBA 8 bits, du plus grand au plus petit, chacun aligné
+ * sur 4 octets (comme GL_UNPACK_ALIGNMENT par défaut).
+ */
+#include "textures.h"
+#include "mapped_file.h"
+#include "workers.h"
+#include "profiler.h"
+#include <SDL_image.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TX_MAGIC      "SGTEX\0\0"
+#define TX_VERSION    1
+#define TX_MAX_LEVELS 16
+#define TX_CACHE_DIR  "cache"
+
+typedef struct tx_header_t tx_header_t;
+struct tx_header_t {
+  char     magic[8];
+  uint32_t version, header_size;
+  uint64_t hash;
+  uint32_t width, height, levels, total_size;
+  uint32_t offsets[TX_MAX_LEVELS];
+};
+
+/* un chargement ; state passe de TX_DECODING à TX_READY ou TX_FAILED
+ * dans le thread de travail, les champs suivants ne sont lus par le
+ * thread GL qu'ensuite */
+enum { TX_DECODING = 0, TX_READY, TX_FAILED };
+
+typedef struct tx_job_t tx_job_t;
+struct tx_job_t {
+  GLuint tex;
+  char path[256];
+  SDL_atomic_t state;
+  mf_file_t mf;
+  void * blob;
+  const tx_header_t * hdr;
+  /* prochain niveau à transférer (on descend vers 0) */
+  int next_level;
+  tx_job_t * next;
+};
+
+static tx_job_t * _jobs = NULL;
+static GLuint _pbo = 0;
+
+static uint32_t align4(uint32_t x) {
+  return (x + 3u) & ~3u;
+}
+
+static uint32_t levelSize(uint32_t w, uint32_t h) {
+  return align4(w * 4) * h;
+}
+
+/* réduction 2x2 (boîte) d'un niveau RGBA, bords répétés si impair */
+static void downsample(const uint8_t * src, uint32_t sw, uint32_t sh, uint8_t * dst, uint32_t dw, uint32_t dh) {
+  uint32_t x, y, c, sp = align4(sw * 4), dp = align4(dw * 4);
+  for(y = 0; y < dh; ++y) {
+    const uint8_t * r0 = src + (2 * y) * sp, * r1 = src + (2 * y + 1 < sh ? 2 * y + 1 : 2 * y) * sp;
+    for(x = 0; x < dw; ++x) {
+      uint32_t x0 = 2 * x * 4, x1 = (2 * x + 1 < sw ? 2 * x + 1 : 2 * x) * 4;
+      for(c = 0; c < 4; ++c)
+	dst[y * dp + x * 4 + c] = (uint8_t)((r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) >> 2);
+    }
+  }
+}
+
+/* décode path et construit le bloc (en-tête + chaîne de mipmaps) */
+static void * build(const char * path, uint64_t hash, uint32_t * size) {
+  SDL_Surface * orig = IMG_Load(path), * rgba;
+  tx_header_t h;
+  uint32_t l, w, hh, off, y;
+  uint8_t * blob;
+  if(!orig)
+    return NULL;
+  /* conversion directe en RGBA octet par octet, sans surface intermédiaire */
+  rgba = SDL_ConvertSurfaceFormat(orig, SDL_PIXELFORMAT_RGBA32, 0);
+  SDL_FreeSurface(orig);
+  if(!rgba)
+    return NULL;
+  memset(&h, 0, sizeof h);
+  memcpy(h.magic, TX_MAGIC, sizeof h.magic);
+  h.version = TX_VERSION;
+  h.header_size = sizeof h;
+  h.hash = hash;
+  h.width = rgba->w;
+  h.height = rgba->h;
+  off = align4(sizeof h);
+  for(l = 0, w = h.width, hh = h.height; l < TX_MAX_LEVELS; ++l) {
+    h.offsets[l] = off;
+    off += levelSize(w, hh);
+    ++h.levels;
+    if(w == 1 && hh == 1) break;
+    w = w > 1 ? w / 2 : 1;
+    hh = hh > 1 ? hh / 2 : 1;
+  }
+  h.total_size = off;
+  if(!(blob = (uint8_t *)malloc(off))) {
+    SDL_FreeSurface(rgba);
+    return NULL;
+  }
+  memcpy(blob, &h, sizeof h);
+  /* niveau 0 : recopie ligne à ligne (le pas de la surface peut différer) */
+  for(y = 0; y < h.height; ++y)
+    memcpy(blob + h.offsets[0] + y * align4(h.width * 4), (uint8_t *)rgba->pixels + y * rgba->pitch, h.width * 4);
+  SDL_FreeSurface(rgba);
+  for(l = 1, w = h.width, hh = h.height; l < h.levels; ++l) {
+    uint32_t nw = w > 1 ? w / 2 : 1, nh = hh > 1 ? hh / 2 : 1;
+    downsample(blob + h.offsets[l - 1], w, hh, blob + h.offsets[l], nw, nh);
+    w = nw;
+    hh = nh;
+  }
+  *size = off;
+  return blob;
+}
+
+static int validate(tx_job_t * j, const void * data, size_t size, uint64_t hash) {
+  const tx_header_t * h = (const tx_header_t *)data;
+  if(size < sizeof *h || memcmp(h->magic, TX_MAGIC, sizeof h->magic) || h->version != TX_VERSION ||
+     h->header_size != sizeof *h || h->hash != hash || h->total_size != size ||
+     h->levels == 0 || h->levels > TX_MAX_LEVELS)
+    return 0;
+  j->hdr = h;
+  j->next_level = h->levels - 1;
+  return 1;
+}
+
+/* cache projeté, ou décodage + mipmaps + écriture du cache */
+static void charger(tx_job_t * j) {
+  uint64_t hash;
+  uint32_t size = 0;
+  char cpath[256];
+  if(!mfHashFile(j->path, &hash)) {
+    SDL_AtomicSet(&j->state, TX_FAILED);
+    return;
+  }
+  snprintf(cpath, sizeof cpath, TX_CACHE_DIR "/%016llx.tex", (unsigned long long)hash);
+  if(mfOpen(cpath, &j->mf)) {
+    if(validate(j, j->mf.data, j->mf.size, hash)) {
+      SDL_AtomicSet(&j->state, TX_READY);
+      return;
+    }
+    mfClose(&j->mf);
+  }
+  if(!(j->blob = build(j->path, hash, &size))) {
+    fprintf(stderr, "Texture: impossible de charger %s\n", j->path);
+    SDL_AtomicSet(&j->state, TX_FAILED);
+    return;
+  }
+  /* échec d'écriture du cache sans conséquence : on garde le bloc en RAM */
+  mfWriteAtomic(cpath, j->blob, size);
+  validate(j, j->blob, size, hash);
+  SDL_AtomicSet(&j->state, TX_READY);
+}
+
+/* tâche du pool */
+static void decode(void * arg) {
+  pfThreadName("worker");
+  pfBegin("decode texture");
+  charger((tx_job_t *)arg);
+  pfEnd();
+}
+
+int txLoadAsync(GLuint tex, const char * path, GLuint fallback) {
+  tx_job_t * j;
+  /* texel de repli, seul niveau utilisable tant que rien n'est transféré */
+  glBindTexture(GL_TEXTURE_2D, tex);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &fallback);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  if(!(j = (tx_job_t *)calloc(1, sizeof *j)))
+    return 0;
+  j->tex = tex;
+  snprintf(j->path, sizeof j->path, "%s", path);
+  SDL_AtomicSet(&j->state, TX_DECODING);
+  j->next = _jobs;
+  _jobs = j;
+  if(!_pbo)
+    glGenBuffers(1, &_pbo);
+  wkSubmit(decode, j);
+  return 1;
+}
+
+static void release(tx_job_t * j) {
+  mfClose(&j->mf);
+  free(j->blob);
+  free(j);
+}
+
+/* transfère les niveaux de j tenant dans *budget ; retourne 1 si fini */
+static int upload(tx_job_t * j, GLsizeiptr * budget) {
+  const tx_header_t * h = j->hdr;
+  int first = 1;
+  glBindTexture(GL_TEXTURE_2D, j->tex);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbo);
+  while(j->next_level >= 0) {
+    int l = j->next_level;
+    GLsizei w = h->width >> l ? h->width >> l : 1, hh = h->height >> l ? h->height >> l : 1;
+    GLsizeiptr sz = levelSize(w, hh);
+    void * p;
+    /* toujours au moins un niveau par appel, même s'il dépasse le budget */
+    if(!first && sz > *budget)
+      break;
+    first = 0;
+    /* orphelinage : le pilote peut encore lire l'ancien contenu */
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, sz, NULL, GL_STREAM_DRAW);
+    if((p = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, sz, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT))) {
+      memcpy(p, (const uint8_t *)h + h->offsets[l], sz);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA, w, hh, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    }
+    /* les niveaux [l, levels - 1] sont complets : les rendre utilisables */
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, l);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, h->levels - 1);
+    *budget -= sz;
+    --j->next_level;
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return j->next_level < 0;
+}
+
+int txPoll(GLsizeiptr budget) {
+  tx_job_t ** pj = &_jobs;
+  int pending = 0;
+  while(*pj) {
+    tx_job_t * j = *pj;
+    int state = SDL_AtomicGet(&j->state), done = 0;
+    if(state == TX_FAILED)
+      done = 1;
+    else if(state == TX_READY && budget > 0)
+      done = upload(j, &budget);
+    if(done) {
+      *pj = j->next;
+      release(j);
+    } else {
+      ++pending;
+      pj = &j->next;
+    }
+  }
+  return pending;
+}
+
+void txFinish(void) {
+  wkWait();
+  while(txPoll(TX_UPLOAD_BUDGET))
+    ;
+}
+
+void txQuit(void) {
+  /* les tâches de décodage pointent sur les chargements */
+  wkWait();
+  while(_jobs) {
+    tx_job_t * j = _jobs;
+    _jobs = j->next;
+    release(j);
+  }
+  if(_pbo) {
+    glDeleteBuffers(1, &_pbo);
+    _pbo = 0;
+  }
+}
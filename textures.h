@@ -0,0 +1,38 @@
+/*!\file textures.h
+ *
+ * \brief chargement asynchrone des textures : décodage (SDL2_image),
+ * conversion RGBA et construction de la chaîne de mipmaps dans le
+ * pool de threads, résultat enregistré dans un cache binaire prêt
+ * pour le GPU (dossier cache/, identifié par l'empreinte du fichier
+ * image) et projeté en mémoire aux exécutions suivantes.
+ *
+ * Le transfert vers le GPU se fait depuis le thread GL (txPoll,
+ * appelée à chaque frame) à travers un pixel buffer object, niveau par
+ * niveau du plus petit au plus grand et dans un budget d'octets par
+ * frame : la texture est utilisable dès le premier niveau transféré
+ * et s'affine ensuite.
+ */
+#ifndef _TEXTURES_H
+#define _TEXTURES_H
+
+#include <GL4D/gl4dummies.h>
+
+/*!\brief budget par défaut de transfert vers le GPU, en octets par frame. */
+#define TX_UPLOAD_BUDGET (4 << 20)
+
+/*!\brief met dans la texture \a tex (déjà générée, ses paramètres
+ * d'enroulement choisis par l'appelant) le texel \a fallback (RGBA)
+ * puis lance le chargement de \a path en tâche de fond. Retourne 0 en
+ * cas d'échec d'allocation (la texture garde alors \a fallback). */
+extern int  txLoadAsync(GLuint tex, const char * path, GLuint fallback);
+/*!\brief à appeler depuis le thread GL : transfère au plus \a budget
+ * octets de niveaux prêts. Retourne le nombre de textures encore en
+ * cours de chargement. */
+extern int  txPoll(GLsizeiptr budget);
+/*!\brief attend la fin de tous les chargements et transferts (utile
+ * hors ligne ou pour mesurer). */
+extern void txFinish(void);
+/*!\brief abandonne les chargements en cours et libère les ressources. */
+extern void txQuit(void);
+
+#endif
@@ -0,0 +1,251 @@
+/*!\file transforms.cpp
+ *
+ * \brief transformations SoA de la scène. Voir transforms.h.
+ *
+ * Les noeuds sont créés parent avant enfant ; ils sont parcourus par
+ * profondeur croissante (ordre _order, niveaux _levels) pour que la
+ * matrice monde d'un parent soit toujours prête avant celles de ses
+ * enfants. Un niveau est découpé entre les threads (wkParallelFor) à
+ * partir de TF_GRAIN noeuds.
+ */
+#include "transforms.h"
+#include "workers.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#  define TF_SSE 1
+#  include <xmmintrin.h>
+#endif
+
+#ifndef M_PI
+#  define M_PI 3.14159265358979323846
+#endif
+
+/* noeuds par morceau de boucle parallèle */
+#define TF_GRAIN 512
+/* alignement des matrices monde (une ligne de cache) */
+#define TF_ALIGN 64
+
+static int _n = 0, _max = 0;
+/* composantes locales (TF_*), axe unitaire de rotation, parent et
+ * profondeur de chaque noeud */
+static float * _c[TF_CHANNELS];
+static float * _ax = NULL, * _ay = NULL, * _az = NULL;
+static int * _parent = NULL, * _depth = NULL;
+/* matrices monde, 16 flottants par noeud */
+static float * _world = NULL;
+/* noeuds par profondeur croissante et début de chaque niveau */
+static int * _order = NULL, * _levels = NULL, _nlevels = 0, _dirty = 0;
+/* liaisons (SoA) */
+static int _nb = 0, _maxb = 0;
+static int * _b_node = NULL, * _b_channel = NULL, * _b_source = NULL;
+static float * _b_base = NULL, * _b_gain = NULL, * _b_exp = NULL;
+
+static void * alignedAlloc(size_t size) {
+#if defined(_MSC_VER)
+  return _aligned_malloc(size, TF_ALIGN);
+#else
+  void * p = NULL;
+  if(posix_memalign(&p, TF_ALIGN, size))
+    return NULL;
+  return p;
+#endif
+}
+
+static void alignedFree(void * p) {
+#if defined(_MSC_VER)
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+int tfInit(int max_nodes, int max_bindings) {
+  int k, ok = 1;
+  tfQuit();
+  if(max_nodes <= 0)
+    return 0;
+  for(k = 0; k < TF_CHANNELS; ++k)
+    ok = (_c[k] = (float *)malloc(max_nodes * sizeof(float))) && ok;
+  _ax = (float *)malloc(max_nodes * sizeof *_ax);
+  _ay = (float *)malloc(max_nodes * sizeof *_ay);
+  _az = (float *)malloc(max_nodes * sizeof *_az);
+  _parent = (int *)malloc(max_nodes * sizeof *_parent);
+  _depth = (int *)malloc(max_nodes * sizeof *_depth);
+  _order = (int *)malloc(max_nodes * sizeof *_order);
+  _levels = (int *)malloc((max_nodes + 1) * sizeof *_levels);
+  _world = (float *)alignedAlloc((size_t)max_nodes * 16 * sizeof *_world);
+  if(max_bindings > 0) {
+    _b_node = (int *)malloc(max_bindings * sizeof *_b_node);
+    _b_channel = (int *)malloc(max_bindings * sizeof *_b_channel);
+    _b_source = (int *)malloc(max_bindings * sizeof *_b_source);
+    _b_base = (float *)malloc(max_bindings * sizeof *_b_base);
+    _b_gain = (float *)malloc(max_bindings * sizeof *_b_gain);
+    _b_exp = (float *)malloc(max_bindings * sizeof *_b_exp);
+    ok = ok && _b_node && _b_channel && _b_source && _b_base && _b_gain && _b_exp;
+  }
+  if(!ok || !_ax || !_ay || !_az || !_parent || !_depth || !_order || !_levels || !_world) {
+    tfQuit();
+    return 0;
+  }
+  _max = max_nodes;
+  _maxb = max_bindings > 0 ? max_bindings : 0;
+  return 1;
+}
+
+int tfNode(int parent, float tx, float ty, float tz, float ax, float ay, float az, float angle, float scale) {
+  float l = sqrtf(ax * ax + ay * ay + az * az);
+  int i = _n;
+  if(_n >= _max || parent >= _n)
+    return -1;
+  if(l <= 0.0f) {
+    ax = 0.0f; ay = 1.0f; az = 0.0f; l = 1.0f;
+  }
+  _c[TF_TX][i] = tx;
+  _c[TF_TY][i] = ty;
+  _c[TF_TZ][i] = tz;
+  _c[TF_ANGLE][i] = angle;
+  _c[TF_SCALE][i] = scale;
+  _ax[i] = ax / l;
+  _ay[i] = ay / l;
+  _az[i] = az / l;
+  _parent[i] = parent < 0 ? -1 : parent;
+  _depth[i] = parent < 0 ? 0 : _depth[parent] + 1;
+  _dirty = 1;
+  return _n++;
+}
+
+int tfBind(int node, int channel, int source, float base, float gain, float exponent) {
+  if(_nb >= _maxb || node < 0 || node >= _n || channel < 0 || channel >= TF_CHANNELS || source < 0)
+    return 0;
+  _b_node[_nb] = node;
+  _b_channel[_nb] = channel;
+  _b_source[_nb] = source;
+  _b_base[_nb] = base;
+  _b_gain[_nb] = gain;
+  _b_exp[_nb] = exponent;
+  ++_nb;
+  return 1;
+}
+
+/* tri par profondeur (comptage), stable : l'ordre de création est
+ * gardé dans chaque niveau */
+static void ordonner(void) {
+  int i, d;
+  _nlevels = 0;
+  for(i = 0; i < _n; ++i)
+    if(_depth[i] + 1 > _nlevels)
+      _nlevels = _depth[i] + 1;
+  memset(_levels, 0, (_nlevels + 1) * sizeof *_levels);
+  for(i = 0; i < _n; ++i)
+    ++_levels[_depth[i] + 1];
+  for(d = 0; d < _nlevels; ++d)
+    _levels[d + 1] += _levels[d];
+  for(i = 0; i < _n; ++i)
+    _order[_levels[_depth[i]]++] = i;
+  /* _levels[d] pointe maintenant sur la fin du niveau d : décaler */
+  for(d = _nlevels; d > 0; --d)
+    _levels[d] = _levels[d - 1];
+  _levels[0] = 0;
+  _dirty = 0;
+}
+
+/* matrice locale T x R x S du noeud i, par lignes */
+static void locale(int i, float * m) {
+  float a = _c[TF_ANGLE][i] * (float)(M_PI / 180.0), s = _c[TF_SCALE][i];
+  float c = cosf(a), sn = sinf(a), t = 1.0f - c;
+  float x = _ax[i], y = _ay[i], z = _az[i];
+  m[0]  = (c + x * x * t) * s;     m[1]  = (x * y * t - z * sn) * s; m[2]  = (x * z * t + y * sn) * s; m[3]  = _c[TF_TX][i];
+  m[4]  = (y * x * t + z * sn) * s; m[5]  = (c + y * y * t) * s;     m[6]  = (y * z * t - x * sn) * s; m[7]  = _c[TF_TY][i];
+  m[8]  = (z * x * t - y * sn) * s; m[9]  = (z * y * t + x * sn) * s; m[10] = (c + z * z * t) * s;     m[11] = _c[TF_TZ][i];
+  m[12] = 0.0f;                    m[13] = 0.0f;                    m[14] = 0.0f;                    m[15] = 1.0f;
+}
+
+/* r = a x b, matrices 4x4 par lignes ; r n'est ni a ni b */
+static void produit(const float * a, const float * b, float * r) {
+  int i;
+#ifdef TF_SSE
+  /* ligne i de r = somme des lignes k de b pondérées par a[i][k] ;
+   * b est local (pile, non aligné), r et a sont alignés */
+  __m128 b0 = _mm_loadu_ps(b), b1 = _mm_loadu_ps(b + 4), b2 = _mm_loadu_ps(b + 8), b3 = _mm_loadu_ps(b + 12);
+  for(i = 0; i < 4; ++i) {
+    __m128 l = _mm_mul_ps(_mm_set1_ps(a[4 * i]), b0);
+    l = _mm_add_ps(l, _mm_mul_ps(_mm_set1_ps(a[4 * i + 1]), b1));
+    l = _mm_add_ps(l, _mm_mul_ps(_mm_set1_ps(a[4 * i + 2]), b2));
+    l = _mm_add_ps(l, _mm_mul_ps(_mm_set1_ps(a[4 * i + 3]), b3));
+    _mm_store_ps(r + 4 * i, l);
+  }
+#else
+  int j;
+  for(i = 0; i < 4; ++i)
+    for(j = 0; j < 4; ++j)
+      r[4 * i + j] = a[4 * i] * b[j] + a[4 * i + 1] * b[4 + j] + a[4 * i + 2] * b[8 + j] + a[4 * i + 3] * b[12 + j];
+#endif
+}
+
+/* compose les noeuds _order[debut + begin..debut + end) d'un même
+ * niveau commençant à *\a arg (debut) */
+static void composer(void * arg, int begin, int end) {
+  const int * ordre = _order + *(const int *)arg;
+  float m[16];
+  int k;
+  for(k = begin; k < end; ++k) {
+    int i = ordre[k];
+    if(_parent[i] < 0)
+      locale(i, _world + 16 * i);
+    else {
+      locale(i, m);
+      produit(_world + 16 * _parent[i], m, _world + 16 * i);
+    }
+  }
+}
+
+void tfUpdate(const float * sources) {
+  int k, d;
+  /* liaisons déclaratives */
+  for(k = 0; k < _nb; ++k) {
+    float x = sources[_b_source[k]];
+    if(_b_exp[k] != 1.0f)
+      x = x > 0.0f ? powf(x, _b_exp[k]) : 0.0f;
+    _c[_b_channel[k]][_b_node[k]] = _b_base[k] + _b_gain[k] * x;
+  }
+  if(_dirty)
+    ordonner();
+  /* un niveau après l'autre, chacun découpé entre les threads */
+  for(d = 0; d < _nlevels; ++d) {
+    int b = _levels[d], n = _levels[d + 1] - b;
+    if(n <= TF_GRAIN)
+      composer(&b, 0, n);
+    else
+      wkParallelFor(n, TF_GRAIN, composer, &b);
+  }
+}
+
+const float * tfWorld(int node) {
+  return _world + 16 * node;
+}
+
+int tfCount(void) {
+  return _n;
+}
+
+void tfQuit(void) {
+  int k;
+  for(k = 0; k < TF_CHANNELS; ++k) {
+    free(_c[k]);
+    _c[k] = NULL;
+  }
+  free(_ax); free(_ay); free(_az);
+  free(_parent); free(_depth); free(_order); free(_levels);
+  free(_b_node); free(_b_channel); free(_b_source);
+  free(_b_base); free(_b_gain); free(_b_exp);
+  alignedFree(_world);
+  _ax = _ay = _az = NULL;
+  _parent = _depth = _order = _levels = NULL;
+  _b_node = _b_channel = _b_source = NULL;
+  _b_base = _b_gain = _b_exp = NULL;
+  _world = NULL;
+  _n = _max = _nb = _maxb = _nlevels = _dirty = 0;
+}
@@ -0,0 +1,56 @@
+/*!\file transforms.h
+ *
+ * \brief transformations de la scène, rangées par composante (SoA)
+ * plutôt que recomposées objet par objet sur la pile de matrices
+ * GL4D.
+ *
+ * Chaque noeud a un parent (ou aucun) et une transformation locale
+ * T(tx, ty, tz) x R(axe, angle) x S(échelle uniforme). Les composantes
+ * animées sont décrites par des liaisons déclaratives : composante =
+ * base + gain x source^exposant, les sources (temps, niveau sonore,
+ * attaques...) étant fournies à chaque frame par l'appelant.
+ *
+ * tfUpdate évalue les liaisons puis compose les matrices monde niveau
+ * de hiérarchie par niveau (noyau SSE, repli scalaire), en parallèle
+ * sur le pool de threads quand un niveau est assez grand. Les
+ * matrices, par lignes comme celles de GL4D, sont ensuite copiées
+ * dans les blocs d'objets (uniform_blocks.h), transférés en une fois.
+ */
+#ifndef _TRANSFORMS_H
+#define _TRANSFORMS_H
+
+/*!\brief composantes animables d'un noeud (angle en degrés). */
+enum {
+  TF_TX = 0,
+  TF_TY,
+  TF_TZ,
+  TF_ANGLE,
+  TF_SCALE,
+  TF_CHANNELS
+};
+
+/*!\brief réserve la place pour \a max_nodes noeuds et \a max_bindings
+ * liaisons. Retourne 0 en cas d'échec. */
+extern int          tfInit(int max_nodes, int max_bindings);
+/*!\brief ajoute un noeud enfant de \a parent (-1 pour une racine,
+ * sinon un noeud déjà créé), translaté de (\a tx, \a ty, \a tz),
+ * tourné de \a angle degrés autour de l'axe (\a ax, \a ay, \a az) et
+ * mis à l'échelle \a scale. Retourne son indice, -1 si plus de place. */
+extern int          tfNode(int parent, float tx, float ty, float tz,
+			   float ax, float ay, float az, float angle, float scale);
+/*!\brief à chaque tfUpdate, la composante \a channel (TF_*) du noeud
+ * \a node vaut \a base + \a gain x sources[\a source]^\a exponent.
+ * Retourne 0 si plus de place. */
+extern int          tfBind(int node, int channel, int source, float base, float gain, float exponent);
+/*!\brief évalue les liaisons avec \a sources puis recalcule toutes
+ * les matrices monde. */
+extern void         tfUpdate(const float * sources);
+/*!\brief matrice monde (4x4, par lignes) du noeud \a node, valide
+ * jusqu'au prochain tfUpdate. */
+extern const float * tfWorld(int node);
+/*!\brief nombre de noeuds. */
+extern int          tfCount(void);
+/*!\brief libère tout. */
+extern void         tfQuit(void);
+
+#endif
@@ -0,0 +1,101 @@
+/*!\file uniform_blocks.cpp
+ *
+ * \brief buffer d'uniformes persistant découpé en régions
+ * tournantes. Voir uniform_blocks.h.
+ */
+#include "uniform_blocks.h"
+#include "buffer_ring.h"
+#include <stdlib.h>
+
+static br_ring_t _ring;
+static int _max_materials = 0, _max_objects = 0;
+/* tailles alignées sur GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT ; une région
+ * contient l'éclairage, les matériaux puis les objets */
+static GLsizeiptr _light_size = 0, _material_size = 0, _object_size = 0, _objects_offset = 0, _region_size = 0;
+/* copie en RAM à défaut de projection persistante */
+static GLubyte * _staging = NULL;
+
+static GLsizeiptr alignUp(GLsizeiptr x, GLint a) {
+  return (x + a - 1) / a * a;
+}
+
+int ubInit(int max_materials, int max_objects) {
+  GLint align = 256;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+  _max_materials = max_materials;
+  _max_objects = max_objects;
+  _light_size = alignUp(sizeof(ub_light_t), align);
+  _material_size = alignUp(sizeof(ub_material_t), align);
+  _object_size = alignUp(sizeof(ub_object_t), align);
+  _objects_offset = _light_size + max_materials * _material_size;
+  _region_size = alignUp(_objects_offset + max_objects * _object_size, align);
+  if(!brInit(&_ring, GL_UNIFORM_BUFFER, _region_size))
+    return 0;
+  /* pas de buffer persistant : copie en RAM et un transfert par frame */
+  if(!_ring.mapped && !(_staging = (GLubyte *)calloc(1, _region_size)))
+    return 0;
+  return 1;
+}
+
+void ubBindProgram(GLuint pId) {
+  GLuint i;
+  if((i = glGetUniformBlockIndex(pId, "light_block")) != GL_INVALID_INDEX)
+    glUniformBlockBinding(pId, i, UB_LIGHT_BINDING);
+  if((i = glGetUniformBlockIndex(pId, "material_block")) != GL_INVALID_INDEX)
+    glUniformBlockBinding(pId, i, UB_MATERIAL_BINDING);
+  if((i = glGetUniformBlockIndex(pId, "object_block")) != GL_INVALID_INDEX)
+    glUniformBlockBinding(pId, i, UB_OBJECT_BINDING);
+}
+
+/* début de la région courante, côté CPU */
+static GLubyte * regionData(void) {
+  GLubyte * p = brData(&_ring);
+  return p ? p : _staging;
+}
+
+ub_light_t * ubBeginFrame(void) {
+  brBegin(&_ring);
+  return (ub_light_t *)regionData();
+}
+
+ub_material_t * ubMaterial(int i) {
+  return (ub_material_t *)(regionData() + _light_size + i * _material_size);
+}
+
+ub_object_t * ubObject(int i) {
+  return (ub_object_t *)(regionData() + _objects_offset + i * _object_size);
+}
+
+void ubFlush(void) {
+  GLintptr base = brOffset(&_ring);
+  if(!_ring.mapped) {
+    glBindBuffer(GL_UNIFORM_BUFFER, _ring.buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, base, _region_size, _staging);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+  glBindBufferRange(GL_UNIFORM_BUFFER, UB_LIGHT_BINDING, _ring.buffer, base, sizeof(ub_light_t));
+}
+
+void ubUseMaterial(int i) {
+  glBindBufferRange(GL_UNIFORM_BUFFER, UB_MATERIAL_BINDING, _ring.buffer,
+		    brOffset(&_ring) + _light_size + i * _material_size, sizeof(ub_material_t));
+}
+
+void ubUseObject(int i) {
+  glBindBufferRange(GL_UNIFORM_BUFFER, UB_OBJECT_BINDING, _ring.buffer,
+		    brOffset(&_ring) + _objects_offset + i * _object_size, sizeof(ub_object_t));
+}
+
+void ubEndFrame(void) {
+  brEnd(&_ring);
+}
+
+int ubPersistent(void) {
+  return _ring.mapped != NULL;
+}
+
+void ubQuit(void) {
+  brQuit(&_ring);
+  free(_staging);
+  _staging = NULL;
+}
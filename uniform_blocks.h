@@ -0,0 +1,89 @@
+/*!\file uniform_blocks.h
+ *
+ * \brief blocs d'uniformes std140 de l'éclairage (un par frame), des
+ * matériaux et des transformations (un par objet), rangés dans un unique buffer
+ * persistant (GL 4.4 / ARB_buffer_storage), découpé en trois régions
+ * tournantes protégées par des fences (buffer_ring.h) pour ne jamais écrire dans une
+ * région encore lue par le GPU. Sans buffer persistant, une copie en
+ * RAM est transférée en un seul glBufferSubData par frame.
+ *
+ * Par objet, il ne reste que des glBindBufferRange avant le dessin.
+ */
+#ifndef _UNIFORM_BLOCKS_H
+#define _UNIFORM_BLOCKS_H
+
+#include <GL4D/gl4dummies.h>
+
+/*!\brief points de liaison des blocs light_block et material_block. */
+#define UB_LIGHT_BINDING    0
+#define UB_MATERIAL_BINDING 1
+/*!\brief point de liaison du bloc object_block. */
+#define UB_OBJECT_BINDING   2
+
+/*!\brief bloc light_block du fragment shader (std140) : la lumière
+ * principale puis les paramètres des clusters de la variante
+ * SV_CLUSTERED (voir clUpdate dans clustered_lights.h). */
+typedef struct ub_light_t ub_light_t;
+struct ub_light_t {
+  GLfloat ambient[4];
+  GLfloat diffuse[4];
+  GLfloat specular[4];
+  GLfloat position[4];
+  GLfloat cluster_scale[4];
+  GLint   cluster_dims[4];
+};
+
+/*!\brief bloc material_block des shaders (std140) ; les booléens
+ * GLSL occupent 4 octets. */
+typedef struct ub_material_t ub_material_t;
+struct ub_material_t {
+  GLfloat ambient[4];
+  GLfloat diffuse[4];
+  GLfloat specular[4];
+  GLfloat mult_tex_coord;
+  GLint   use_texture;
+  GLint   use_nm_texture;
+  GLint   use_instancing;
+};
+
+/*!\brief bloc object_block du vertex shader (std140, row_major) :
+ * matrice de modélisation et matrice des normales de view x model,
+ * par lignes comme les matrices GL4D ; chaque ligne de la matrice 3x3
+ * occupe 4 flottants. Puis l'amplitude du déplacement des sommets par
+ * le spectre (0 pour aucun, voir spectrum_texture.h). */
+typedef struct ub_object_t ub_object_t;
+struct ub_object_t {
+  GLfloat model[16];
+  GLfloat normal_matrix[12];
+  GLfloat displacement;
+  GLfloat pad[3];
+};
+
+/*!\brief créé le buffer pour au plus \a max_materials matériaux et
+ * \a max_objects objets par frame. Retourne 0 en cas d'échec. */
+extern int             ubInit(int max_materials, int max_objects);
+/*!\brief associe les blocs du programme \a pId à leurs points de
+ * liaison (à faire une fois par programme, après l'édition de liens). */
+extern void            ubBindProgram(GLuint pId);
+/*!\brief commence une frame : attend que le GPU ait fini de lire la
+ * région courante et retourne le bloc d'éclairage à remplir. */
+extern ub_light_t *    ubBeginFrame(void);
+/*!\brief retourne le matériau \a i de la frame courante, à remplir. */
+extern ub_material_t * ubMaterial(int i);
+/*!\brief retourne l'objet \a i de la frame courante, à remplir. */
+extern ub_object_t *   ubObject(int i);
+/*!\brief rend visibles au GPU les blocs remplis (un seul transfert
+ * sans buffer persistant) et lie le bloc d'éclairage. */
+extern void            ubFlush(void);
+/*!\brief lie le matériau \a i pour les prochains dessins. */
+extern void            ubUseMaterial(int i);
+/*!\brief lie l'objet \a i pour les prochains dessins. */
+extern void            ubUseObject(int i);
+/*!\brief termine la frame (pose la fence de la région). */
+extern void            ubEndFrame(void);
+/*!\brief retourne 1 si le buffer est persistant. */
+extern int             ubPersistent(void);
+/*!\brief libère le buffer. */
+extern void            ubQuit(void);
+
+#endif
@@ -6,52 +6,261 @@
 #include <GL4D/gl4dg.h>
 /* pour la macro RGB */
 #include <GL4D/gl4dp.h>
-/* pour IMG_Load */
-#include <SDL_image.h>
 /* pour l'ensemble des fonctions liées au son */
 #include <SDL_mixer.h>
+/* pour l'analyse spectrale des blocs audio */
+#include "audio_analysis.h"
+/* pour transmettre les caractéristiques audio au thread de rendu */
+#include "feature_ring.h"
+/* pour la pré-analyse du morceau et son cache sur disque */
+#include "feature_cache.h"
+/* pour les blocs d'uniformes de l'éclairage et des matériaux */
+#include "uniform_blocks.h"
+/* pour le mode foule (rendu instancié) */
+#include "crowd.h"
+/* pour le pool de threads et le chargement asynchrone des textures */
+#include "workers.h"
+#include "textures.h"
+/* pour le rendu hors ligne */
+#include "offline.h"
+/* pour le profileur intégré */
+#include "profiler.h"
+/* pour les variantes de shaders et leur cache binaire */
+#include "shader_variants.h"
+/* pour la compensation de la latence son-image */
+#include "av_sync.h"
+/* pour la lecture enchaînée d'une liste de morceaux */
+#include "playlist.h"
+/* pour les transformations de la scène */
+#include "transforms.h"
+/* pour les niveaux de détail du cône et de la sphère */
+#include "meshes.h"
+/* pour le spectre transmis au vertex shader */
+#include "spectrum_texture.h"
+/* pour les lumières ponctuelles animées par le spectre */
+#include "clustered_lights.h"
+/* pour la résolution dynamique et la régularité des frames */
+#include "dynamic_resolution.h"
+#include "frame_pacer.h"
+/* pour l'enregistrement et le rejeu des entrées */
+#include "replay.h"
+
+/* taille de la FFT et nombre de bandes du spectre */
+#define TAILLE_FFT 1024
+#define NB_BANDES  32
+/* pas (en échantillons) de la pré-analyse hors ligne */
+#define PAS_ANALYSE 512
+
+/* indices des matériaux de chaque objet dans les blocs d'uniformes */
+enum { MAT_CONE = 0, MAT_PLAN, MAT_SPHERE, MAT_FOULE, NB_MATERIAUX = MAT_FOULE + CR_PRIMITIVES };
+/* variante de shaders de chaque objet, selon les options de son matériau */
+#define VAR_CONE   SV_PLAIN
+#define VAR_PLAN   (SV_TEXTURE | SV_NORMAL_MAP)
+#define VAR_SPHERE SV_TEXTURE
+#define VAR_FOULE  SV_INSTANCING
+#ifndef M_PI
+#  define M_PI 3.14159265358979323846
+#endif
+/* échelle minimale (par côté) de la résolution dynamique */
+#define ECHELLE_MIN 0.5
+/* profondeurs couvertes par les tranches des clusters de lumières */
+#define CL_PROCHE  1.0f
+#define CL_LOIN    40.0f
+/* indices des blocs de transformation des objets dessinés */
+enum { OBJ_CONE = 0, OBJ_PLAN, OBJ_SPHERE, NB_OBJETS };
+/* noeuds de la scène, dans l'ordre de création (parent avant enfant) :
+ * le cône et l'orbite de la sphère tournent autour du même centre */
+enum { NOEUD_PLAN = 0, NOEUD_CENTRE, NOEUD_CONE, NOEUD_ORBITE, NOEUD_SPHERE, NB_NOEUDS };
+/* amplitude du déplacement des sommets par le spectre et rayon
+ * englobant (espace objet, déplacement compris) du cône et de la
+ * sphère */
+#define DEPL_CONE   0.25f
+#define DEPL_SPHERE 0.35f
+#define RAYON_CONE   (1.4143f * (1.0f + DEPL_CONE))
+#define RAYON_SPHERE (1.0f + DEPL_SPHERE)
+/* sources des liaisons animées : angle d'animation (degrés), niveau
+ * sonore lissé, proximité de la prochaine attaque connue (0 à 1) */
+enum { SRC_TEMPS = 0, SRC_SON, SRC_ATTAQUE, NB_SOURCES };
 
 static void init(void);
+static void scene(void);
+static void preparerProgramme(GLuint pId);
 static void initAudio(const char * filename);
 static void mixCallback(void *udata, Uint8 *stream, int len);
 static void draw(void);
+static void clavier(int keycode);
+static int  horsLigne(void);
+static void lumieres(int n, const aa_features_t * f, float a);
 static void quit(void);
 
-/* on créé une variable pour stocker l'identifiant du programme GPU */
-GLuint _pId = 0;
-/* on créé une variable pour stocker l'identifiant de la géométrie : un plan, un cube et une sphère GL4D */
+/* on créé une variable pour stocker l'identifiant de la géométrie : un plan GL4D */
 GLuint _plan = 0;
-GLuint _sphere = 0;
-GLuint _cone = 0;
+/* niveaux de détail de la sphère et du cône, choisis à chaque frame
+ * selon leur taille à l'écran */
+static ms_lod_t _sphere, _cone;
 /* entiers (positifs) pour y stocker les identifiants de textures
  * OpenGL générées. */
 GLuint _texId[] = { 0, 0, 0 };
 /* pointeur vers la musique chargée par SDL2_Mixer */
 static Mix_Music * _mmusic = NULL;
-/* pour stocker la moyenne du son sur 1/44 de seconde (cherchez pourquoi 1/44) */
-static double _moyenne_son = 0.0;
+/* analyseur spectral utilisé par mixCallback, ses buffers sont
+ * alloués une fois pour toutes dans initAudio */
+static aa_analyzer_t * _analyzer = NULL;
+/* fréquence et nombre de canaux effectivement ouverts par SDL_mixer */
+static int _audio_rate = 44100, _audio_channels = 2;
+/* nombre de trames déjà analysées, n'est touché que par mixCallback */
+static Uint64 _audio_frames = 0;
+/* anneau des blocs analysés : écrit par mixCallback, vidé par draw */
+static fr_ring_t _ring;
+/* enveloppe (lissage et crêtes) des blocs reçus, n'est touchée que par draw */
+static fr_envelope_t _env;
+/* dernier bloc reçu par draw, pour estimer la position de lecture */
+static fr_frame_t _dernier_bloc;
+/* pré-analyse du morceau ; une fois prête, mixCallback n'analyse plus
+ * et draw lit les caractéristiques à la position de lecture */
+static fc_cache_t * _precache = NULL;
+/* liste de morceaux (option -liste), jouée à la place de _mmusic, et
+ * dernier morceau annoncé */
+static const char * _liste = NULL;
+static pl_playlist_t * _playlist = NULL;
+static int _morceau = -1;
+/*!\brief instant du flux où le morceau _morceau a commencé. */
+static double _debut_morceau = 0.0;
+/* 1 quand la pré-analyse du morceau entendu est prête : écrit par
+ * draw, lu par mixCallback qui n'analyse plus */
+static SDL_atomic_t _morceau_pret;
+/* nombre d'instances par primitive du mode foule (0 si désactivé,
+ * voir l'option -foule) et affichage de la foule (touche c) */
+static int _foule = 0, _foule_visible = 1;
+/* nombre de lumières ponctuelles (0 si désactivé, voir l'option
+ * -lumieres) et leur affichage (touche l) */
+static int _lumieres = 0, _lumieres_visibles = 1;
+/* dimensions de la fenêtre (et des images hors ligne) */
+static int _largeur = 800, _hauteur = 800;
+/* rendu hors ligne (option -horsligne) : fichier de sortie, images
+ * par seconde, pas de temps fixe (0 en temps réel) et frame courante */
+static const char * _hors_ligne = NULL;
+static int _ips = 30, _frames_max = 0;
+static double _pas_fixe = 0.0;
+static Uint64 _frame = 0;
+/* surimpression des durées de frame (touche p, avec -profil) */
+static int _profil_visible = 0;
+/* taille (trames) des tampons audio (option -tampon) et latence de
+ * la chaîne de diffusion en ms (option -latence, touche t) */
+static int _tampon_audio = 1024;
+static double _latence = 0.0;
+/* horloge du flux audio et historique des blocs, n'est touché que
+ * par le thread de rendu */
+static as_sync_t _sync;
+/* durée lissée d'une frame, pour prédire l'instant d'affichage */
+static double _dt_lisse = 1.0 / 60.0;
+/* budget de temps GPU par frame en ms (option -budget, 0 sans
+ * résolution dynamique), cadence visée en images par seconde (option
+ * -cadence, 0 sans régulation) et intervalle de la dernière frame
+ * régulée */
+static double _budget = 0.0, _cadence = 0.0, _dt_cadence = 0.0;
+/* journal des entrées à écrire (option -enregistre) ou à rejouer
+ * (option -rejoue) et début du rejeu */
+static const char * _enregistre = NULL, * _rejoue = NULL;
+static double _debut_rejeu = -1.0;
 
 /*!\brief créé la fenêtre, un screen 2D effacé en noir et lance une
  *  boucle infinie.*/
 int main(int argc, char ** argv) {
+  int i;
+  /* options : -foule N pour N instances de chaque primitive,
+   * -horsligne FICHIER pour un rendu hors ligne de tout le morceau
+   * ("-" pour la sortie standard), -ips N et -taille LxH pour ses
+   * images, -frames N pour s'arrêter après N images, -tampon N pour
+   * des tampons audio de N trames, -latence MS pour la latence de la
+   * diffusion, -liste FICHIER pour enchaîner les morceaux d'une
+   * liste, -lumieres N pour N lumières ponctuelles, -budget MS pour
+   * adapter la résolution à MS ms de GPU par frame, -cadence HZ pour
+   * présenter les frames à HZ images par seconde, -enregistre
+   * FICHIER pour enregistrer les entrées de chaque frame, -rejoue
+   * FICHIER pour les rejouer sans audio, -profil PREFIXE pour
+   * profiler (PREFIXE.json et PREFIXE.csv) */
+  for(i = 1; i < argc; ++i) {
+    if(!strcmp(argv[i], "-foule") && i + 1 < argc)
+      _foule = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-budget") && i + 1 < argc)
+      _budget = atof(argv[++i]);
+    else if(!strcmp(argv[i], "-cadence") && i + 1 < argc)
+      _cadence = atof(argv[++i]);
+    else if(!strcmp(argv[i], "-enregistre") && i + 1 < argc)
+      _enregistre = argv[++i];
+    else if(!strcmp(argv[i], "-rejoue") && i + 1 < argc)
+      _rejoue = argv[++i];
+    else if(!strcmp(argv[i], "-lumieres") && i + 1 < argc)
+      _lumieres = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-horsligne") && i + 1 < argc)
+      _hors_ligne = argv[++i];
+    else if(!strcmp(argv[i], "-ips") && i + 1 < argc)
+      _ips = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-tampon") && i + 1 < argc)
+      _tampon_audio = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-latence") && i + 1 < argc)
+      _latence = atof(argv[++i]);
+    else if(!strcmp(argv[i], "-liste") && i + 1 < argc)
+      _liste = argv[++i];
+    else if(!strcmp(argv[i], "-frames") && i + 1 < argc)
+      _frames_max = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-taille") && i + 1 < argc)
+      sscanf(argv[++i], "%dx%d", &_largeur, &_hauteur);
+    else if(!strcmp(argv[i], "-profil") && i + 1 < argc) {
+      if(!pfInit(argv[++i]))
+	fprintf(stderr, "pfInit: impossible d'allouer le profileur\n");
+    }
+  }
+  pfThreadName("rendu");
+  if(_ips < 1) _ips = 30;
+  if(_tampon_audio < 64 || _tampon_audio > 8192) _tampon_audio = 1024;
+  if(_largeur < 1 || _hauteur < 1) _largeur = _hauteur = 800;
+  /* le rejeu remplace l'audio, l'horloge et le rendu hors ligne ; les
+   * pas de temps viennent du journal, sans régulation, et la
+   * résolution reste pleine pour que la charge ne dépende pas de la
+   * machine */
+  if(_rejoue) {
+    _hors_ligne = NULL;
+    _liste = NULL;
+    _enregistre = NULL;
+    _budget = _cadence = 0.0;
+  }
+  /* hors ligne, ni résolution dynamique ni régulation : tout est au
+   * pas fixe et à pleine résolution */
+  if(_hors_ligne)
+    _budget = _cadence = 0.0;
+  /* pilotes SDL sans écran ni carte son */
+  if(_hors_ligne)
+    olPrepareEnv();
   /* tentative de création d'une fenêtre pour GL4Dummies */
   if(!gl4duwCreateWindow(argc, argv, /* args du programme */
 			 "GL4Dummies' Crabes Danse", /* titre */
-			 10, 10, 800, 800, /* x,y, largeur, heuteur */
-			 GL4DW_SHOWN) /* état visible */) {
+			 10, 10, _largeur, _hauteur, /* x,y, largeur, heuteur */
+			 _hors_ligne ? GL4DW_HIDDEN : GL4DW_SHOWN) /* état visible */) {
     /* ici si échec de la création souvent lié à un problème d'absence
      * de contexte graphique ou d'impossibilité d'ouverture d'un
      * contexte OpenGL (au moins 3.2) */
     return 1;
   }
   /* appeler init pour initialiser des paramètres GL et GL4D */
+  pfBegin("init");
   init();
+  pfEnd();
   /* appeler initAudio pour ouvrir l'audio, le fichier son et commencer à le jouer */
+  pfBegin("initAudio");
   initAudio("audio/noisestorm_crab.mp3");
+  pfEnd();
   /* placer quit comme fonction à appeler au moment du exit */
   atexit(quit);
+  /* hors ligne : pas de boucle d'événements, toutes les frames du
+   * morceau sont dessinées au pas fixe puis on quitte */
+  if(_hors_ligne)
+    return horsLigne();
   /* placer draw comme fonction à appeler pour dessiner chaque frame */
   gl4duwDisplayFunc(draw);
+  /* placer clavier comme fonction à appeler à l'appui d'une touche */
+  gl4duwKeyDownFunc(clavier);
   /* boucle infinie pour éviter que le programme ne s'arrête et ferme
    * la fenêtre immédiatement */
   gl4duwMainLoop();
@@ -70,12 +279,22 @@ void init(void) {
   glEnable(GL_DEPTH_TEST);
   /* générer un plan en GL4D */
   _plan = gl4dgGenQuadf();
-  /* générer un cube en GL4D */
-  _sphere = gl4dgGenSpheref(5, 9);
-  /* générer une sphere en GL4D */
-  _cone = gl4dgGenConef(4,9);
-  /* créer un programme GPU pour OpenGL (en GL4D) */
-  _pId = gl4duCreateProgram("<vs>shaders/light_n_tex.vs", "<fs>shaders/light_n_tex.fs", NULL);
+  /* générer les niveaux de détail de la sphère (8x6 à 64x48) et du
+   * cône (8 à 64 côtés) : le déplacement par le spectre demande des
+   * sommets, mais seulement quand l'objet est grand à l'écran */
+  if(!msGenSphereLod(&_sphere, 8, 6) || !msGenConeLod(&_cone, 8, 2)) {
+    fprintf(stderr, "msGen*Lod: impossible de creer les maillages\n");
+    exit(12);
+  }
+  /* la texture du spectre, mise à jour à chaque frame */
+  if(!stInit(NB_BANDES)) {
+    fprintf(stderr, "stInit: impossible de creer la texture du spectre\n");
+    exit(13);
+  }
+  /* lire les shaders dont les variantes seront compilées (ou lues
+   * dans le cache) plus bas */
+  if(!svInit("shaders/light_n_tex.vs", "shaders/light_n_tex.fs", preparerProgramme))
+    exit(2);
   /* créer dans GL4D une matrice qui s'appelle model ; matrice de
      modélisation qu'on retrouvera dans le vertex shader */
   gl4duGenMatrix(GL_FLOAT, "model");
@@ -92,7 +311,41 @@ void init(void) {
   /* combiner la matrice courante avec une matrice de projection en
      perspective. Voir le support de cours pour les six paramètres :
      left, right, bottom, top, near, far */
-  gl4duFrustumf(-1, 1, -1, 1, 1, 1000);
+  gl4duFrustumf(-1, 1, -_hauteur / (GLfloat)_largeur, _hauteur / (GLfloat)_largeur, 1, 1000);
+  /* blocs d'uniformes : lier les blocs du programme une fois pour
+   * toutes et créer le buffer des matériaux */
+  if(!ubInit(NB_MATERIAUX, NB_OBJETS)) {
+    fprintf(stderr, "ubInit: impossible de creer le buffer d'uniformes\n");
+    exit(7);
+  }
+  /* les transformations de la scène et leurs animations */
+  scene();
+  /* toutes les variantes utilisées, maintenant plutôt qu'à la
+   * première frame qui en a besoin */
+  if(!svProgram(VAR_CONE) || !svProgram(VAR_PLAN) || !svProgram(VAR_SPHERE) || !svProgram(VAR_FOULE))
+    exit(2);
+  /* les lumières ponctuelles, si elles sont demandées, et leurs
+   * variantes */
+  if(_lumieres > 0 && !clInit(_lumieres, CL_PROCHE, CL_LOIN)) {
+    fprintf(stderr, "clInit: impossible de creer %d lumieres (au plus %d, textures buffer suffisantes)\n",
+	    _lumieres, CL_MAX_LIGHTS);
+    _lumieres = 0;
+  }
+  if(_lumieres > 0 && (!svProgram(VAR_CONE | SV_CLUSTERED) || !svProgram(VAR_PLAN | SV_CLUSTERED) ||
+		       !svProgram(VAR_SPHERE | SV_CLUSTERED) || !svProgram(VAR_FOULE | SV_CLUSTERED)))
+    exit(2);
+  /* la résolution dynamique et la régulation, si elles sont demandées */
+  if(_budget > 0.0 && !drInit(_largeur, _hauteur, _budget, ECHELLE_MIN)) {
+    fprintf(stderr, "drInit: impossible de creer le framebuffer hors ecran\n");
+    _budget = 0.0;
+  }
+  if(_cadence > 0.0)
+    fpInit(_cadence);
+  /* la foule, si elle est demandée */
+  if(_foule > 0 && !crInit(_foule)) {
+    fprintf(stderr, "crInit: impossible de creer la foule de %d instances\n", _foule);
+    _foule = 0;
+  }
 
   /* Générer 3 identifiants de texture côté OpenGL (GPU) pour y
    * transférer des textures. */
@@ -112,103 +365,199 @@ void init(void) {
    * et ses données */
   glBindTexture(GL_TEXTURE_2D, 0);
 
+  /* les deux textures de bois sont décodées par le pool de threads,
+   * avec leurs mipmaps, puis transférées au fil des frames par
+   * txPoll ; d'ici là elles gardent un texel de repli */
+  wkInit(0);
   /* binder la texture générée comme texture 2D côté GPU */
   glBindTexture(GL_TEXTURE_2D, _texId[1]);
   /* paramétrer quelques propriétés de texture : voir la doc OpenGL de glTexParameteri */
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR /* on veut la lisser */);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR /* on veut la lisser, mipmaps comprises */);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR /* on veut la lisser */);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT /* on veut la rendre cyclique */);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT /* on veut la rendre cyclique */);
-  /* bloc concernant le chargement de fichier image, sa conversion
-   * dans notre format RGBA et son transfert vers le GPU */
-  {
-    /* utilisation de SDL2_image pour charger une image au format png */
-    SDL_Surface * orig = IMG_Load("images/wood_maps/wood_color.png");
-    /* si échec de chargement, mettre une texture avec un seul pixel blanc */
-    if(orig == NULL) {
-      GLuint blanc = -1; /* ou 0xFFFFFFFF */
-      /* transfert du pixel blanc */
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &blanc);      
-    } else {
-      /* création d'une surface SDL (image) compatible avec mon format de transfert OpenGL */
-      SDL_Surface * image_au_format_RGBA = SDL_CreateRGBSurface(0, orig->w, orig->h, 32, R_MASK, G_MASK, B_MASK, A_MASK);
-      /* copie de orig vers image_au_format_RGBA en convertissant au format de image_au_format_RGBA */
-      SDL_BlitSurface(orig, NULL, image_au_format_RGBA, NULL);
-      /* plus besoin d'orig, libérer la mémoire */
-      SDL_FreeSurface(orig);
-      /* fonction de transfert de données (texels) RGBA de CPU vers GPU :
-       * fonction assez riche, voir sa doc */
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image_au_format_RGBA->w, image_au_format_RGBA->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_au_format_RGBA->pixels);
-      /* plus besoin de image_au_format_RGBA, libérer la mémoire */
-      SDL_FreeSurface(image_au_format_RGBA);
-    }
-  }
-  /* à ce niveau pixels en RAM-CPU n'est plus nécessaire */
-  /* dé-binder la texture, par mesure de protection de ses paramètres
-   * et ses données */
   glBindTexture(GL_TEXTURE_2D, 0);
+  /* si échec de chargement, la texture garde un seul pixel blanc */
+  txLoadAsync(_texId[1], "images/wood_maps/wood_color.png", (GLuint)-1 /* ou 0xFFFFFFFF */);
 
-  /* pensez à faire une fonction car ici il y a beaucoup de répétitions */
   /* binder la texture générée comme texture 2D côté GPU */
   glBindTexture(GL_TEXTURE_2D, _texId[2]);
   /* paramétrer quelques propriétés de texture : voir la doc OpenGL de glTexParameteri */
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR /* on veut la lisser */);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR /* on veut la lisser, mipmaps comprises */);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR /* on veut la lisser */);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT /* on veut la rendre cyclique */);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT /* on veut la rendre cyclique */);
-  /* bloc concernant le chargement de fichier image, sa conversion
-   * dans notre format RGBA et son transfert vers le GPU */
-  {
-    /* utilisation de SDL2_image pour charger une image au format png */
-    SDL_Surface * orig = IMG_Load("images/wood_maps/wood_normal.png");
-    /* si échec de chargement, mettre une texture avec un seul pixel noir */
-    if(orig == NULL) {
-      GLuint noir = 0;
-      /* transfert du pixel noir */
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &noir);      
-    } else {
-      /* création d'une surface SDL (image) compatible avec mon format de transfert OpenGL */
-      SDL_Surface * image_au_format_RGBA = SDL_CreateRGBSurface(0, orig->w, orig->h, 32, R_MASK, G_MASK, B_MASK, A_MASK);
-      /* copie de orig vers image_au_format_RGBA en convertissant au format de image_au_format_RGBA */
-      SDL_BlitSurface(orig, NULL, image_au_format_RGBA, NULL);
-      /* plus besoin d'orig, libérer la mémoire */
-      SDL_FreeSurface(orig);
-      /* fonction de transfert de données (texels) RGBA de CPU vers GPU :
-       * fonction assez riche, voir sa doc */
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image_au_format_RGBA->w, image_au_format_RGBA->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_au_format_RGBA->pixels);
-      /* plus besoin de image_au_format_RGBA, libérer la mémoire */
-      SDL_FreeSurface(image_au_format_RGBA);
-    }
-  }
-  /* à ce niveau pixels en RAM-CPU n'est plus nécessaire */
-  /* dé-binder la texture, par mesure de protection de ses paramètres
-   * et ses données */
   glBindTexture(GL_TEXTURE_2D, 0);
+  /* si échec de chargement, la texture garde un seul pixel noir */
+  txLoadAsync(_texId[2], "images/wood_maps/wood_normal.png", 0);
+}
+
+/*!\brief créé les noeuds de la scène et lie leurs composantes
+ * animées aux sources (voir transforms.h). */
+static void scene(void) {
+  if(!tfInit(NB_NOEUDS, 16)) {
+    fprintf(stderr, "tfInit: impossible d'allouer les transformations\n");
+    exit(11);
+  }
+  /* le plan, couché (rotation de -90 autour de x) et agrandi x15 */
+  tfNode(-1, 0, 0, 0, 1, 0, 0, -90, 15);
+  /* le centre, 1.5 au-dessus du sol */
+  tfNode(-1, 0, 1.5f, 0, 0, 1, 0, 0, 1);
+  /* le cône tourne sur lui-même (a / 5) et grossit avec le son en
+   * restant posé comme avant : échelle s = 1 + 0.5 son², montée de
+   * 1.5 (s - 1) */
+  tfNode(NOEUD_CENTRE, 0, 0, 0, 0, 1, 0, 0, 1);
+  tfBind(NOEUD_CONE, TF_ANGLE, SRC_TEMPS, 0, 0.2f, 1);
+  tfBind(NOEUD_CONE, TF_SCALE, SRC_SON, 1, 0.5f, 2);
+  tfBind(NOEUD_CONE, TF_TY, SRC_SON, 0, 0.75f, 2);
+  /* l'orbite de la sphère (a / 2) autour du centre */
+  tfNode(NOEUD_CENTRE, 0, 0, 0, 0, 1, 0, 0, 1);
+  tfBind(NOEUD_ORBITE, TF_ANGLE, SRC_TEMPS, 0, 0.5f, 1);
+  /* la sphère, à 3 du centre, roule (-a autour de x) et grossit en
+   * anticipant la prochaine attaque */
+  tfNode(NOEUD_ORBITE, 3, 0, 0, 1, 0, 0, 0, 1);
+  tfBind(NOEUD_SPHERE, TF_ANGLE, SRC_TEMPS, 0, -1.0f, 1);
+  tfBind(NOEUD_SPHERE, TF_SCALE, SRC_ATTAQUE, 1, 0.3f, 1);
+}
+
+/*!\brief remplit le bloc \a o avec la matrice monde du noeud \a
+ * noeud, sa matrice des normales pour la vue \a view et l'amplitude
+ * \a deplacement du déplacement par le spectre. */
+static void objet(ub_object_t * o, const GLfloat * view, int noeud, GLfloat deplacement) {
+  const GLfloat * m = tfWorld(noeud);
+  GLfloat n[9];
+  int i;
+  memcpy(o->model, m, sizeof o->model);
+  svNormalMatrix(view, m, n);
+  for(i = 0; i < 3; ++i) {
+    memcpy(o->normal_matrix + 4 * i, n + 3 * i, 3 * sizeof *n);
+    o->normal_matrix[4 * i + 3] = 0.0f;
+  }
+  o->displacement = deplacement;
+}
+
+/*!\brief appelée sur chaque variante de programme à sa création (elle
+ * est alors en cours) : blocs d'uniformes et samplers. */
+static void preparerProgramme(GLuint pId) {
+  ubBindProgram(pId);
+  /* les unités de texture ne changent jamais : les samplers sont fixés
+   * ici plutôt qu'à chaque frame */
+  glUniform1i(glGetUniformLocation(pId, "my_texture"), 0 /* le 0 correspond à GL_TEXTURE0 */);
+  glUniform1i(glGetUniformLocation(pId, "my_nm_texture"), 1 /* le 1 correspond à GL_TEXTURE1 */);
+  glUniform1i(glGetUniformLocation(pId, "spectrum"), ST_UNIT);
+  glUniform1i(glGetUniformLocation(pId, "cl_lights"), CL_UNIT_LIGHTS);
+  glUniform1i(glGetUniformLocation(pId, "cl_grid"), CL_UNIT_GRID);
+  glUniform1i(glGetUniformLocation(pId, "cl_indices"), CL_UNIT_INDICES);
+}
+
+/*!\brief place les \a n lumières ponctuelles sur des anneaux autour
+ * du centre, tournant avec l'angle d'animation \a a. La lumière i suit
+ * la bande i modulo le nombre de bandes de \a f : sa teinte (rouge
+ * pour les graves, bleu pour les aigus), sa hauteur, sa portée et son
+ * intensité. */
+static void lumieres(int n, const aa_features_t * f, float a) {
+  int i;
+  for(i = 0; i < n; ++i) {
+    cl_light_t * l = clLight(i);
+    int b = f->nbands > 0 ? i % f->nbands : 0;
+    float e = f->nbands > 0 ? f->bands[b] : 0.0f;
+    float t = f->nbands > 1 ? b / (float)(f->nbands - 1) : 0.0f;
+    /* rayon de 2 à 7, réparti sans suivre l'ordre des bandes : suite
+     * de l'inverse du nombre d'or, uniforme quel que soit n (un
+     * multiple fixe de i modulo n repliait les rayons si n lui était
+     * multiple) */
+    float g = 0.618034f * i, r = 2.0f + 5.0f * (g - floorf(g));
+    float angle = (float)(2.0 * M_PI * i / n) + a * (0.002f + 0.002f * (i & 3));
+    l->position[0] = r * cosf(angle);
+    l->position[1] = 0.2f + 2.5f * e;
+    l->position[2] = r * sinf(angle);
+    l->radius = 1.0f + 2.0f * e;
+    l->color[0] = 1.0f - t;
+    l->color[1] = 1.0f - fabsf(2.0f * t - 1.0f);
+    l->color[2] = t;
+    l->intensity = 0.2f + 2.5f * e * e;
+  }
 }
 
 /*!\brief Cette fonction initialise les paramètres SDL_Mixer et charge
  *  le fichier audio.*/
 static void initAudio(const char * filename) {
   int mixFlags = MIX_INIT_MP3 /* on veut une gestion du MP3 */, res;
+  rp_audio_t chaine;
+  /* rejeu : aucun périphérique audio, la chaîne de l'enregistrement
+   * pour l'horloge du flux ; les textures sont chargées d'avance
+   * pour que chaque frame soit identique */
+  if(_rejoue) {
+    if(!rpReplay(_rejoue, &chaine))
+      exit(14);
+    _audio_rate = chaine.rate;
+    frInit(&_ring);
+    frEnvelopeInit(&_env, 0.01f, 0.15f, 1.5f);
+    asInit(&_sync, chaine.rate, chaine.buffer_frames, chaine.fft_size, chaine.latency / 1000.0);
+    txFinish();
+    return;
+  }
   res = Mix_Init(mixFlags);
   if( (res & mixFlags) != mixFlags ) {
     fprintf(stderr, "Mix_Init: Erreur lors de l'initialisation de la bibliotheque SDL_Mixer\n");
     fprintf(stderr, "Mix_Init: %s\n", Mix_GetError());
     exit(3); /* commenter car il arrive qu'il gère mais qu'il dit que non ????? */
   }
-  /* ouvrir l'audio en 44Khz, 16bits/échantillon, stéréo et 1024
-   * packets soumis à la fois à la callBack */
-  if(Mix_OpenAudio(44100, AUDIO_S16LSB, 2, 1024) < 0)
+  /* ouvrir l'audio en 44Khz, 16bits/échantillon, stéréo et
+   * _tampon_audio (1024 par défaut, 128 ou 256 pour moins de
+   * latence) packets soumis à la fois à la callBack */
+  if(Mix_OpenAudio(44100, AUDIO_S16LSB, 2, _tampon_audio) < 0)
     exit(4);
-  /* ouvrir le fichier audio passé en paramètre */
-  if(!(_mmusic = Mix_LoadMUS(filename))) {
-    fprintf(stderr, "Erreur lors du Mix_LoadMUS: %s\n", Mix_GetError());
-    exit(5);
+  /* créer l'analyseur avec le format réellement obtenu */
+  {
+    Uint16 format = AUDIO_S16LSB;
+    Mix_QuerySpec(&_audio_rate, &format, &_audio_channels);
+    if(!(_analyzer = aaNew(TAILLE_FFT, NB_BANDES, _audio_rate))) {
+      fprintf(stderr, "aaNew: impossible de creer l'analyseur audio\n");
+      exit(6);
+    }
+  }
+  /* une liste : décodage et pré-analyse de chaque morceau dans le
+   * thread de la liste, pendant que le précédent est joué (le rendu
+   * hors ligne reste sur un seul morceau) */
+  if(_liste && !_hors_ligne) {
+    if(!(_playlist = plLoad(_liste, TAILLE_FFT, NB_BANDES, PAS_ANALYSE)))
+      exit(5);
+  } else {
+    /* ouvrir le fichier audio passé en paramètre */
+    if(!(_mmusic = Mix_LoadMUS(filename))) {
+      fprintf(stderr, "Erreur lors du Mix_LoadMUS: %s\n", Mix_GetError());
+      exit(5);
+    }
+    /* pré-analyse du morceau dans un thread (ou lecture de son cache) */
+    _precache = fcLoadAsync(filename, TAILLE_FFT, NB_BANDES, PAS_ANALYSE);
   }
+  /* anneau vide et enveloppe : montée 10ms, descente 150ms, crêtes
+   * décroissant de 1.5 par seconde */
+  frInit(&_ring);
+  frEnvelopeInit(&_env, 0.01f, 0.15f, 1.5f);
+  /* horloge et historique du flux pour la compensation de latence */
+  asInit(&_sync, _audio_rate, _tampon_audio, TAILLE_FFT, _latence / 1000.0);
+  /* le journal des entrées, avec la chaîne audio pour le rejeu */
+  if(_enregistre) {
+    chaine.rate = _audio_rate;
+    chaine.buffer_frames = _tampon_audio;
+    chaine.fft_size = TAILLE_FFT;
+    chaine.latency = _latence;
+    if(!rpRecord(_enregistre, &chaine))
+      _enregistre = NULL;
+  }
+  /* hors ligne, rien n'est joué : tout vient de la pré-analyse */
+  if(_hors_ligne)
+    return;
   /* mise en place de la fonction callBack pendant le play */
   Mix_SetPostMix(mixCallback, NULL);
+  /* la liste remplace la musique ; elle se cale sur le compteur de
+   * mixCallback pour que les deux partagent la même horloge du flux */
+  if(_playlist)
+    plStart(_playlist, &_audio_frames);
   /* si tu ne joues pas, joue une fois ! */
-  if(!Mix_PlayingMusic())
+  else if(!Mix_PlayingMusic())
     Mix_PlayMusic(_mmusic, 1);
 }
 
@@ -222,20 +571,61 @@ static void initAudio(const char * filename) {
  * l'exemple ici : 1024x2x2 = 4096. Attention si stéréo, un
  * échantillon sur deux est pour chaque sortie (gauche/droite). */
 static void mixCallback(void *udata, Uint8 *stream, int len) {
-  Sint16 *s16 = (Sint16 *)stream;
-  /* je me contente de moyenner les intensités du son */
-  int i;
-  double moyenne = 0.0;
-  for(i = 0; i < len / 2 /* car 2 octets par échantillon */; ++i) {
-    moyenne += (s16[i] < 0.0 ? -s16[i] : s16[i]) / (double)(1<<13);
-  }
-  moyenne = moyenne / i;
-  _moyenne_son = moyenne < 1.0 ? moyenne : 1.0;
+  fr_frame_t fr;
+  int frames = len / (2 * _audio_channels);
+  pfThreadName("audio");
+  pfBegin("mixCallback");
+  fr.wall = SDL_GetPerformanceCounter() / (double)SDL_GetPerformanceFrequency();
+  fr.t = _audio_frames / (double)_audio_rate;
+  fr.duration = frames / (double)_audio_rate;
+  _audio_frames += frames;
+  /* spectre, RMS par canal, crête et flux ; aucune allocation ici.
+   * Inutile si la pré-analyse (du morceau ou de celui de la liste
+   * entendu) est prête, seul l'horodatage compte. */
+  if((_precache && fcStatus(_precache) == FC_READY) || SDL_AtomicGet(&_morceau_pret))
+    fr.f.nbands = 0;
+  else
+    aaProcessS16(_analyzer, (const int16_t *)stream, frames, _audio_channels, &fr.f);
+  /* ne bloque jamais : si draw est en retard le bloc est perdu */
+  frPush(&_ring, &fr);
+  pfSample(PF_CALLBACK, pfEnd());
+}
+
+/*!\brief estime la position (en secondes) dans le flux audio de ce
+ * qui sera entendu quand la frame dessinée à l'instant \a now sera
+ * affichée. */
+static double position_lecture(double now) {
+  /* au pas fixe, la position ne dépend que du numéro de frame */
+  if(_pas_fixe > 0.0)
+    return _frame * _pas_fixe;
+  if(!asReady(&_sync))
+    return 0.0;
+  /* la frame dessinée maintenant sera affichée environ une frame plus tard */
+  return asHeard(&_sync, now + _dt_lisse);
+}
+
+/*!\brief remplit le matériau \a m (couleurs ambiante, diffuse et
+ * spéculaire, répétition de texture et textures utilisées). */
+static void materiau(ub_material_t * m, const GLfloat * amb, const GLfloat * diff, const GLfloat * spec,
+		     GLfloat mult_tex_coord, GLint use_texture, GLint use_nm_texture) {
+  memcpy(m->ambient, amb, sizeof m->ambient);
+  memcpy(m->diffuse, diff, sizeof m->diffuse);
+  memcpy(m->specular, spec, sizeof m->specular);
+  m->mult_tex_coord = mult_tex_coord;
+  m->use_texture = use_texture;
+  m->use_nm_texture = use_nm_texture;
+  m->use_instancing = GL_FALSE;
 }
 
 static double inter_frames_dt(void) {
   static double t0 = -1.0;
-  double t = gl4dGetElapsedTime(), dt;
+  double t, dt;
+  if(_pas_fixe > 0.0)
+    return _pas_fixe;
+  /* frames régulées : le pas de la grille de présentation */
+  if(_cadence > 0.0)
+    return _dt_cadence;
+  t = gl4dGetElapsedTime();
   if(t0 < 0.0) /* ça ne devrait arriver qu'au premier appel */
     t0 = t;
   dt = (t - t0) / 1000.0;
@@ -255,16 +645,124 @@ void draw(void) {
   const GLfloat jaune_clair[] = {0.9f, 0.9f, 0.5f, 1.0f};
   const GLfloat bleu[] = {0.2f, 0.2f, 0.9f, 1.0f};
   static GLfloat position_lumiere[] = {2.0f, 3.5f, -5.5f, 1.0f};
-  GLfloat amplified_amb_light[4], amplified_diff_light[4], amplified_spec_light[4], cam_pos[3];
+  GLfloat cam_pos[3];
+  const GLfloat * vue, * proj;
+  /* viewport, pour la taille des objets à l'écran */
+  GLint vp[4];
+  /* niveaux de détail choisis pour le cône et la sphère */
+  int lod_cone, lod_sphere;
+  /* option des variantes pour les lumières ponctuelles */
+  unsigned cl = _lumieres && _lumieres_visibles ? SV_CLUSTERED : SV_PLAIN;
+  /* bloc d'éclairage de la frame, rempli directement dans le buffer */
+  ub_light_t * lumiere;
+  /* niveau sonore lissé, niveau de crête maintenue et temps restant
+   * avant la prochaine attaque connue (pré-analyse) */
+  double son, son_crete, avance = -1.0;
+  /* temps écoulé depuis la frame précédente et instant de la frame */
+  double dt, now;
+  fr_frame_t fr;
+  /* entrées de la frame, lues du journal ou à y écrire */
+  rp_frame_t entrees;
+  /* valeurs des sources des liaisons animées (transforms.h) */
+  float sources[NB_SOURCES];
+  /* pré-analyse du morceau entendu et position dans ce morceau */
+  fc_cache_t * precache;
+  double t_morceau;
+  /* pour mesurer le délai son-image du dernier bloc reçu */
+  double mixage_precedent = _dernier_bloc.wall;
+  pfFrame();
+  /* rejeu : pas de temps et position de lecture du journal, fin du
+   * programme à sa fin */
+  if(_rejoue) {
+    double t = SDL_GetPerformanceCounter() / (double)SDL_GetPerformanceFrequency();
+    if(_debut_rejeu < 0.0)
+      _debut_rejeu = t;
+    if(!rpNextFrame(&entrees)) {
+      fprintf(stderr, "Rejeu: %d frames en %.2f s (%.1f images/s)\n", rpFrames(), t - _debut_rejeu,
+	      rpFrames() / (t - _debut_rejeu > 0.0 ? t - _debut_rejeu : 1.0));
+      exit(0);
+    }
+    dt = entrees.dt;
+    now = 0.0;
+  } else {
+    dt = inter_frames_dt();
+    now = SDL_GetPerformanceCounter() / (double)SDL_GetPerformanceFrequency();
+  }
+  pfBegin("draw");
+  pfBegin("caracteristiques");
+  /* durée de frame lissée, sans les à-coups (chargements, fenêtre
+   * déplacée) */
+  if(dt > 0.0 && dt < 0.25)
+    _dt_lisse += 0.1 * (dt - _dt_lisse);
+  /* les blocs reçus recalent l'horloge du flux et, sans pré-analyse,
+   * alimentent l'historique */
+  while(_rejoue ? rpNextBlock(&fr) : frPop(&_ring, &fr)) {
+    if(_enregistre)
+      rpBlock(&fr);
+    asPush(&_sync, &fr);
+    _dernier_bloc = fr;
+  }
+  /* caractéristiques de ce qui sera entendu à l'affichage de la frame ;
+   * au rejeu, la position enregistrée : elle ne dépend ni de la
+   * latence (que la calibration change) ni des durées de frame */
+  fr.t = _rejoue ? entrees.heard : position_lecture(now);
+  fr.duration = dt;
+  precache = _precache;
+  t_morceau = fr.t;
+  /* avec une liste, pré-analyse du morceau entendu, à sa position */
+  if(_playlist) {
+    int m = plTrack(_playlist, fr.t, &t_morceau);
+    if(m != _morceau && m >= 0)
+      fprintf(stderr, "Morceau %d/%d : %s\n", m + 1, plCount(_playlist), plName(_playlist, m));
+    _morceau = m;
+    _debut_morceau = fr.t - t_morceau;
+    precache = plFeatures(_playlist, m);
+    /* l'analyse en direct ne reprend qu'en attendant une pré-analyse */
+    SDL_AtomicSet(&_morceau_pret, precache && fcStatus(precache) == FC_READY);
+  }
+  if(_rejoue && entrees.sampled) {
+    /* rejeu : ce que la pré-analyse avait donné */
+    fr.f = entrees.f;
+    frEnvelopeFeed(&_env, &fr);
+    avance = entrees.ahead;
+  } else if(precache && fcStatus(precache) == FC_READY) {
+    fcSample(precache, t_morceau, &fr.f);
+    frEnvelopeFeed(&_env, &fr);
+    if((avance = fcNextOnset(precache, t_morceau)) >= 0.0)
+      avance -= t_morceau;
+    entrees.sampled = 1;
+  } else {
+    if(asSample(&_sync, fr.t, &fr.f))
+      frEnvelopeFeed(&_env, &fr);
+    entrees.sampled = 0;
+  }
+  /* les entrées de la frame et les blocs reçus vont au journal */
+  if(_enregistre) {
+    entrees.dt = dt;
+    entrees.heard = fr.t;
+    entrees.ahead = avance;
+    entrees.f = fr.f;
+    rpFrame(&entrees);
+  }
+  son = _env.smooth.level;
+  son_crete = _env.peak.level;
+  pfEnd();
   /* on bouge un peu la lumière */
   position_lumiere[0] =  6.0f * sin(a / 200.0f);
   position_lumiere[2] = -6.0f * cos(a / 200.0f);
+  /* transférer vers le GPU les niveaux de textures prêts, dans un budget borné */
+  pfBegin("textures");
+  txPoll(TX_UPLOAD_BUDGET);
+  pfEnd();
+  /* dessiner dans le framebuffer à résolution dynamique */
+  if(_budget > 0.0)
+    drBegin();
   /* effacer le buffer de couleur (image) et le buffer de profondeur d'OpenGL */
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  /* utiliser le programme GPU "_pId" */
-  glUseProgram(_pId);
-  /* mettre le facteur de multiplication de texture (répétition, voir le vertex shader) à 1 */
-  glUniform1f(glGetUniformLocation(_pId, "mult_tex_coord"), 1.0f);
+  glGetIntegerv(GL_VIEWPORT, vp);
+  /* pour la taille des objets à l'écran */
+  gl4duBindMatrix("proj");
+  proj = (const GLfloat *)gl4duGetMatrixData();
   /* binder (mettre au premier plan, "en courante" ou "en active") la
      matrice view */
   gl4duBindMatrix("view");
@@ -276,87 +774,101 @@ void draw(void) {
   cam_pos[2] = 6.0f * cos(-a / 1000.0);
   /* composer (multiplication à droite) avec une matrice fabriquée par LookAt */ 
   gl4duLookAtf(cam_pos[0], cam_pos[1], cam_pos[2], 0, 0, 0, 0, 1, 0);
-  /* binder (mettre au premier plan, "en courante" ou "en active") la
-     matrice model */
-  gl4duBindMatrix("model");
+  /* pour les matrices des normales */
+  vue = (const GLfloat *)gl4duGetMatrixData();
 
-  /* amplifier la lumière en fonction du son */
+  /* remplir les blocs d'uniformes de la frame : amplifier la lumière
+   * en fonction du son */
+  pfBegin("uniformes");
+  lumiere = ubBeginFrame();
   for(i = 0; i < 3; ++i) {
-    double a = pow(_moyenne_son, 2.5);
-    amplified_amb_light[i]  = blanc[i] * (1.0 + 0.5 * a); 
-    amplified_diff_light[i] = jaune_clair[i] * (1.0 + 1.5 * a); 
-    amplified_spec_light[i] = blanc[i] * (1.0 + 5.0 * a); 
+    double a = pow(son_crete, 2.5);
+    lumiere->ambient[i]  = blanc[i] * (1.0 + 0.5 * a); 
+    lumiere->diffuse[i]  = jaune_clair[i] * (1.0 + 1.5 * a); 
+    lumiere->specular[i] = blanc[i] * (1.0 + 5.0 * a); 
+  }
+  lumiere->ambient[3] = lumiere->diffuse[3] = lumiere->specular[3] = 1.0f;
+  memcpy(lumiere->position, position_lumiere, sizeof lumiere->position);
+  /* les lumières ponctuelles, rangées dans les clusters de la vue */
+  if(_lumieres && _lumieres_visibles) {
+    pfBegin("lumieres");
+    lumieres(_lumieres, &_env.smooth, a);
+    clUpdate(_lumieres, vue, proj, vp[2], vp[3], lumiere->cluster_scale, lumiere->cluster_dims);
+    pfEnd();
+  } else {
+    memset(lumiere->cluster_scale, 0, sizeof lumiere->cluster_scale);
+    memset(lumiere->cluster_dims, 0, sizeof lumiere->cluster_dims);
+  }
+  /* puis les matériaux des trois objets, en un seul transfert */
+  materiau(ubMaterial(MAT_CONE), rouge, rouge, rouge, 1.0f, GL_FALSE, GL_FALSE);
+  materiau(ubMaterial(MAT_PLAN), blanc, vert_tres_clair, blanc, 20.0f, GL_TRUE, GL_TRUE);
+  materiau(ubMaterial(MAT_SPHERE), bleu, bleu, blanc, 1.0f, GL_TRUE, GL_FALSE);
+  /* la foule : surfaces blanches teintées par la couleur d'instance */
+  if(_foule) {
+    for(i = 0; i < CR_PRIMITIVES; ++i) {
+      ub_material_t * m = ubMaterial(MAT_FOULE + i);
+      materiau(m, blanc, blanc, blanc, 1.0f, GL_FALSE, GL_FALSE);
+      m->use_instancing = GL_TRUE;
+    }
+    if(_foule_visible)
+      crUpdate(&_env.smooth, &_env.peak, a);
   }
-  glUniform4fv(glGetUniformLocation(_pId, "light_ambient_color"), 1, amplified_amb_light);
-  glUniform4fv(glGetUniformLocation(_pId, "light_diffuse_color"), 1, amplified_diff_light);
-  glUniform4fv(glGetUniformLocation(_pId, "light_specular_color"), 1, amplified_spec_light);
-  glUniform4fv(glGetUniformLocation(_pId, "light_position"), 1, position_lumiere);
+  /* les transformations des objets, animées par le son, puis leurs
+   * blocs (matrice monde et des normales) */
+  sources[SRC_TEMPS] = a;
+  sources[SRC_SON] = (float)son;
+  sources[SRC_ATTAQUE] = avance >= 0.0 ? (float)exp(-20.0 * avance) : 0.0f;
+  tfUpdate(sources);
+  objet(ubObject(OBJ_CONE), vue, NOEUD_CONE, DEPL_CONE);
+  objet(ubObject(OBJ_PLAN), vue, NOEUD_PLAN, 0.0f);
+  objet(ubObject(OBJ_SPHERE), vue, NOEUD_SPHERE, DEPL_SPHERE);
+  ubFlush();
+  /* le spectre lissé pour le déplacement des sommets, sur le GPU */
+  stUpdate(_env.smooth.bands, _env.smooth.nbands);
+  /* le niveau de détail de chaque objet selon sa taille à l'écran */
+  lod_cone = msSelectLod(&_cone, msScreenRadius(proj, vue, tfWorld(NOEUD_CONE), RAYON_CONE, vp[3]));
+  lod_sphere = msSelectLod(&_sphere, msScreenRadius(proj, vue, tfWorld(NOEUD_SPHERE), RAYON_SPHERE, vp[3]));
+  pfEnd();
 
-  /***** On commence par la sphère *****/
-  /* mettre la matrice identité (celle qui ne change rien) dans la matrice courante */
-  gl4duLoadIdentityf();
-  /* composer (multiplication à droite) avec un scale lié à l'intensité du son */
-  {
-    double s = 1.0 + 0.5 * pow(_moyenne_son, 2.0);
-    gl4duScalef(s, s, s);
-  }
-  /* composer (multiplication à droite) avec une translation vers le
-     haut <0, 1.5, 0> */
-  gl4duTranslatef(0, 1.5f, 0);  
-  /* composer (multiplication à droite) avec une rotation d'angle a et
-     d'axe (autour de l'axe) <0, 1, 0> */
-  gl4duRotatef(a / 5.0f, 0, 1, 0);
-  /* envoyer les matrice GL4D au programme GPU OpenGL (en cours) */
+  /***** On commence par le cône *****/
+  pfBegin("cone");
+  /* la variante du cône, puis lui envoyer les matrices GL4D (vue et
+   * projection) ; sa transformation est dans son bloc d'objet */
+  svUse(VAR_CONE | cl);
   gl4duSendMatrices();
-  glUniform4fv(glGetUniformLocation(_pId, "surface_ambient_color"), 1, rouge);
-  glUniform4fv(glGetUniformLocation(_pId, "surface_specular_color"), 1, rouge);
-  glUniform4fv(glGetUniformLocation(_pId, "surface_diffuse_color"), 1, rouge);
-  /* demander le dessin d'un objet GL4D */
-  gl4dgDraw(_cone);
+  ubUseObject(OBJ_CONE);
+  ubUseMaterial(MAT_CONE);
+  /* dessiner le niveau de détail choisi */
+  pfGpuBegin("cone");
+  msDraw(&_cone.levels[lod_cone]);
+  pfGpuEnd();
+  pfEnd();
 
 
   /***** On continue avec le plan *****/
-  /* mettre la matrice identité (celle qui ne change rien) dans la matrice courante */
-  gl4duLoadIdentityf();
-  /* composer (multiplication à droite) avec une rotation d'angle -90 et
-     d'axe (autour de l'axe) <1, 0, 0> pour coucher le plan */
-  gl4duRotatef(-90, 1, 0, 0);
-  /* composer (multiplication à droite) avec un scale x5 <15, 15, 15> */
-  gl4duScalef(15, 15, 15);  
-  /* envoyer les matrice GL4D au programme GPU OpenGL (en cours) */
+  pfBegin("plan");
+  /* la variante texturée avec normal map, puis lui envoyer les
+   * matrices GL4D et lier son bloc d'objet */
+  svUse(VAR_PLAN | cl);
   gl4duSendMatrices();
-  glUniform4fv(glGetUniformLocation(_pId, "surface_ambient_color"), 1, blanc);
-  glUniform4fv(glGetUniformLocation(_pId, "surface_diffuse_color"), 1, vert_tres_clair);
-  glUniform4fv(glGetUniformLocation(_pId, "surface_specular_color"), 1, blanc);
+  ubUseObject(OBJ_PLAN);
+  /* matériau texturé, avec normal map et répétition x20 */
+  ubUseMaterial(MAT_PLAN);
 
   /* activer la l'unité 1 pour y stocker une texture de normal map */
   glActiveTexture(GL_TEXTURE1);
   /* binder la texture _texId[2] (normal map de brick) pour l'utiliser sur l'unité 1 */
   glBindTexture(GL_TEXTURE_2D, _texId[2]);
-  /* informer le programme GPU _pId que ma texture est celle posée à l'unité 1 */
-  glUniform1i(glGetUniformLocation(_pId, "my_nm_texture"), 1 /* le 1 correspond à GL_TEXTURE1 */);
-  /* dire que je utilise une normal map */
-  glUniform1i(glGetUniformLocation(_pId, "use_nm_texture"), GL_TRUE);
   /* activer la l'unité 0 pour y stocker une texture */
   glActiveTexture(GL_TEXTURE0);
   /* binder la texture _texId[1] (brick) pour l'utiliser sur l'unité 0 */
   glBindTexture(GL_TEXTURE_2D, _texId[1]);
-  /* informer le programme GPU _pId que ma texture est celle posée à l'unité 0 */
-  glUniform1i(glGetUniformLocation(_pId, "my_texture"), 0 /* le 0 correspond à GL_TEXTURE0 */);
-  /* informer le programme GPU _pId que pour cette surface je souhaite utiliser la texture */
-  glUniform1i(glGetUniformLocation(_pId, "use_texture"), GL_TRUE);
-  /* mettre en place le facteur de multiplication de texture (répétition, voir le vertex shader) */
-  glUniform1f(glGetUniformLocation(_pId, "mult_tex_coord"), 20.0f);
 
   /* demander le dessin d'un objet GL4D */
+  pfGpuBegin("plan");
   gl4dgDraw(_plan);
+  pfGpuEnd();
 
-  /* après mon draw informer le programme GPU _pId que je ne souhaite plus utiliser de texture */
-  glUniform1i(glGetUniformLocation(_pId, "use_texture"), GL_FALSE);
-  /* remettre le facteur de multiplication de texture (répétition, voir le vertex shader) à 1 */
-  glUniform1f(glGetUniformLocation(_pId, "mult_tex_coord"), 1.0f);
-  /* dire que je n'utilise plus de normal map */
-  glUniform1i(glGetUniformLocation(_pId, "use_nm_texture"), GL_FALSE);
   /* dé-binder ma texture pour la désaffecter de l'unité 1 */
   glActiveTexture(GL_TEXTURE1);
   glBindTexture(GL_TEXTURE_2D, 0);
@@ -364,50 +876,170 @@ void draw(void) {
   glActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_2D, 0);
 
+  pfEnd();
+
   /***** On fini avec le cube *****/
-  /* mettre la matrice identité (celle qui ne change rien) dans la matrice courante */
-  gl4duLoadIdentityf();
-  /* composer (multiplication à droite) avec une translation vers le
-     haut <0, 1.5, 0> */
-  gl4duTranslatef(0, 1.5f, 0);  
-  /* composer (multiplication à droite) avec une rotation d'angle -90 et
-     d'axe (autour de l'axe) <1, 0, 0> pour coucher le plan */
-  gl4duRotatef(a / 2.0f, 0, 1, 0);
-  /* composer (multiplication à droite) avec une translation vers la
-     droite <3, 0, 0> */
-  gl4duTranslatef(3, 0, 0);  
-  gl4duRotatef(-a, 1, 0, 0);
-  /* envoyer les matrice GL4D au programme GPU OpenGL (en cours) */
+  pfBegin("sphere");
+  /* la variante de la sphère, puis lui envoyer les matrices GL4D et
+   * lier son bloc d'objet */
+  svUse(VAR_SPHERE | cl);
   gl4duSendMatrices();
-  glUniform4fv(glGetUniformLocation(_pId, "surface_ambient_color"), 1, bleu);
-  glUniform4fv(glGetUniformLocation(_pId, "surface_diffuse_color"), 1, bleu);
-  glUniform4fv(glGetUniformLocation(_pId, "surface_specular_color"), 1, blanc);
+  ubUseObject(OBJ_SPHERE);
+  ubUseMaterial(MAT_SPHERE);
 
   /* activer la l'unité 0 pour y stocker une texture */
   glActiveTexture(GL_TEXTURE0);
   /* binder la texture _texId[0] pour l'utiliser sur l'unité 0 */
   glBindTexture(GL_TEXTURE_2D, _texId[0]);
-  /* informer le programme GPU _pId que ma texture est celle posée à l'unité 0 */
-  glUniform1i(glGetUniformLocation(_pId, "my_texture"), 0 /* le 0 correspond à GL_TEXTURE0 */);
-  /* informer le programme GPU _pId que pour cette surface je souhaite utiliser la texture */
-  glUniform1i(glGetUniformLocation(_pId, "use_texture"), GL_TRUE);
 
-  /* demander le dessin d'un objet GL4D */
-  gl4dgDraw(_sphere);
+  /* dessiner le niveau de détail choisi */
+  pfGpuBegin("sphere");
+  msDraw(&_sphere.levels[lod_sphere]);
+  pfGpuEnd();
 
-  /* après mon draw informer le programme GPU _pId que je ne souhaite plus utiliser de texture */
-  glUniform1i(glGetUniformLocation(_pId, "use_texture"), GL_FALSE);
   /* dé-binder ma texture pour la désaffecter de l'unité 0 */
   glBindTexture(GL_TEXTURE_2D, 0);
 
+  pfEnd();
+
+  /***** Et la foule, un dessin instancié par primitive *****/
+  if(_foule && _foule_visible) {
+    pfBegin("foule");
+    /* la variante instanciée n'a besoin que de view et proj */
+    svUse(VAR_FOULE | cl);
+    gl4duSendMatrices();
+    pfGpuBegin("foule");
+    crDraw(MAT_FOULE);
+    pfGpuEnd();
+    pfEnd();
+  }
+
   /* n'utiliser aucun programme GPU (pas nécessaire) */
   glUseProgram(0);
+  /* agrandir l'image vers la fenêtre */
+  if(_budget > 0.0)
+    drEnd();
+  /* la région des blocs d'uniformes de cette frame est protégée
+   * jusqu'à ce que le GPU l'ait lue */
+  ubEndFrame();
+  /* durées des dernières frames en surimpression */
+  if(_profil_visible) {
+    glGetIntegerv(GL_VIEWPORT, vp);
+    pfOverlay(vp[2], vp[3]);
+  }
+  /* délai entre le mixage d'un nouveau bloc et la fin de la frame qui
+   * l'utilise ; sans objet au rejeu (horodatages d'un autre processus) */
+  if(pfActive() && !_rejoue && _dernier_bloc.wall != mixage_precedent)
+    pfSample(PF_LAG, (SDL_GetPerformanceCounter() / (double)SDL_GetPerformanceFrequency() - _dernier_bloc.wall) * 1000.0);
+  pfEnd();
   /* augmenter l'ange a de 1 */
-  a += 60.0 * inter_frames_dt();
+  a += 60.0 * dt;
+  /* attendre l'échéance de la frame, l'image est présentée au retour */
+  if(_cadence > 0.0)
+    _dt_cadence = fpWait();
+}
+
+/*!\brief appelée à l'appui d'une touche de code \a keycode. */
+static void clavier(int keycode) {
+  switch(keycode) {
+  case SDLK_c:
+    /* afficher ou cacher la foule */
+    _foule_visible = !_foule_visible;
+    break;
+  case SDLK_l:
+    /* allumer ou éteindre les lumières ponctuelles */
+    _lumieres_visibles = !_lumieres_visibles;
+    break;
+  case SDLK_p:
+    /* afficher ou cacher les durées de frame (profileur actif) */
+    _profil_visible = !_profil_visible && pfActive();
+    break;
+  case SDLK_t:
+    /* calibration de la latence : taper en rythme (espace) sur ce que
+     * l'on entend, puis t à nouveau */
+    if(!_sync.calibrating) {
+      asCalibrationStart(&_sync);
+      fprintf(stderr, "Calibration : tapez espace sur les temps, puis t\n");
+    } else {
+      /* avec une liste, grille du morceau entendu, frappes ramenées
+       * à sa position */
+      double c = _playlist ?
+	asCalibrationEnd(&_sync, plFeatures(_playlist, _morceau), _debut_morceau) :
+	asCalibrationEnd(&_sync, _precache, 0.0);
+      if(c == 0.0)
+	fprintf(stderr, "Calibration : pas assez de frappes ou pas de pre-analyse\n");
+      else
+	fprintf(stderr, "Calibration : correction %+.1f ms, relancer avec -latence %.0f\n",
+		c * 1000.0, _sync.latency * 1000.0);
+    }
+    break;
+  case SDLK_SPACE:
+    asTap(&_sync, SDL_GetPerformanceCounter() / (double)SDL_GetPerformanceFrequency());
+    break;
+  default:
+    break;
+  }
+}
+
+/*!\brief rendu hors ligne de tout le morceau à _ips images par
+ * seconde vers _hors_ligne. Retourne le code de sortie du programme. */
+static int horsLigne(void) {
+  int n = 0, nb, ok = 1;
+  double t0 = SDL_GetPerformanceCounter() / (double)SDL_GetPerformanceFrequency(), t1;
+  if(!olInit(_hors_ligne, _largeur, _hauteur))
+    return 8;
+  /* le rendu doit être reproductible : pré-analyse et textures complètes */
+  if(!_precache || fcWait(_precache) != FC_READY) {
+    fprintf(stderr, "Hors ligne: la pre-analyse du morceau a echoue\n");
+    return 9;
+  }
+  txFinish();
+  _pas_fixe = 1.0 / _ips;
+  nb = (int)ceil(fcDuration(_precache) * _ips);
+  if(_frames_max > 0 && _frames_max < nb)
+    nb = _frames_max;
+  for(n = 0; n < nb && ok; ++n, ++_frame) {
+    olBeginFrame();
+    draw();
+    ok = olEndFrame();
+  }
+  ok = olFinish() && ok;
+  t1 = SDL_GetPerformanceCounter() / (double)SDL_GetPerformanceFrequency();
+  fprintf(stderr, "Hors ligne: %d frames %dx%d en %.2f s (%.1f images/s)\n",
+	  olFrames(), _largeur, _hauteur, t1 - t0, olFrames() / (t1 - t0 > 0.0 ? t1 - t0 : 1.0));
+  if(!ok)
+    fprintf(stderr, "Hors ligne: erreur d'ecriture\n");
+  return ok ? 0 : 10;
 }
 
 /* appelée lors du exit */
 void quit(void) {
+  /* terminer le journal des entrées */
+  if(_enregistre) {
+    int n = rpFrames(), perdus = rpDropped();
+    if(perdus)
+      fprintf(stderr, "Enregistrement: %d blocs perdus, le rejeu divergera\n", perdus);
+    if(rpClose())
+      fprintf(stderr, "Enregistrement: %d frames dans %s\n", n, _enregistre);
+    else
+      fprintf(stderr, "Enregistrement: erreur d'ecriture dans %s\n", _enregistre);
+    _enregistre = NULL;
+  }
+  if(_rejoue)
+    rpClose();
+  /* attendre et libérer la pré-analyse avant de fermer l'audio */
+  if(_precache) {
+    fcDelete(_precache);
+    _precache = NULL;
+  }
+  /* retirer la callBack de la liste avant de libérer ses tampons */
+  if(_playlist) {
+    if(plUnderruns(_playlist))
+      fprintf(stderr, "Playlist: %.2f s de silence faute de decodage a temps\n",
+	      plUnderruns(_playlist) / (double)_audio_rate);
+    plDelete(_playlist);
+    _playlist = NULL;
+  }
   /* arrêt de la musique et libération des ressources */
   if(_mmusic) {
     if(Mix_PlayingMusic())
@@ -417,11 +1049,36 @@ void quit(void) {
   }
   Mix_CloseAudio();
   Mix_Quit();
+  /* libérer l'analyseur une fois le thread audio arrêté */
+  if(_analyzer) {
+    aaDelete(_analyzer);
+    _analyzer = NULL;
+  }
+  /* abandonner les chargements en cours puis arrêter le pool de threads */
+  txQuit();
+  wkQuit();
   /* libérer les textures générées côté OpenGL/GPU */
   if(_texId[0]) {
     glDeleteTextures(3, _texId);
     _texId[0] = 0;
   }
+  /* libérer la foule, les programmes et le buffer des blocs d'uniformes */
+  crQuit();
+  svQuit();
+  ubQuit();
+  tfQuit();
+  stQuit();
+  clQuit();
+  if(_budget > 0.0)
+    fprintf(stderr, "Resolution dynamique: echelle finale %.2f, GPU %.2f ms par frame\n", drScale(), drGpuTime());
+  drQuit();
+  if(_cadence > 0.0 && fpMissed())
+    fprintf(stderr, "Cadence: %d echeances manquees a %.0f images/s\n", fpMissed(), _cadence);
+  msDeleteLod(&_cone);
+  msDeleteLod(&_sphere);
+  olQuit();
+  /* exporter le profil (les threads audio et de travail sont arrêtés) */
+  pfQuit();
   /* nettoyer (libérer) tout objet créé avec GL4D */
   gl4duClean(GL4DU_ALL);
 }
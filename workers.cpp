@@ -0,0 +1,194 @@
+/*!\file workers.cpp
+ *
+ * \brief pool de threads de travail. Voir workers.h.
+ */
+#include "workers.h"
+#include <SDL.h>
+
+/* attentes actives avant de céder le cœur dans wkParallelFor */
+#define WK_SPINS 64
+/* boucles parallèles pouvant encore être référencées par des tâches
+ * en retard */
+#define WK_JOBS  8
+/* pause d'attente active (SDL 2.24 et plus), rien sinon */
+#ifndef SDL_CPUPauseInstruction
+#  define SDL_CPUPauseInstruction()
+#endif
+
+typedef struct { wk_func_t f; void * arg; } task_t;
+
+static SDL_Thread * _threads[WK_MAX_THREADS];
+static int _nthreads = 0;
+static SDL_mutex * _mutex = NULL;
+/* tâche disponible / place libre / tout est terminé */
+static SDL_cond * _cond_task = NULL, * _cond_room = NULL, * _cond_idle = NULL;
+static task_t _queue[WK_QUEUE];
+static int _head = 0, _count = 0, _running = 0, _stop = 0;
+
+static int loop(void * unused) {
+  task_t t;
+  (void)unused;
+  SDL_LockMutex(_mutex);
+  for(;;) {
+    while(!_count && !_stop)
+      SDL_CondWait(_cond_task, _mutex);
+    if(!_count && _stop)
+      break;
+    t = _queue[_head];
+    _head = (_head + 1) % WK_QUEUE;
+    --_count;
+    ++_running;
+    SDL_CondSignal(_cond_room);
+    SDL_UnlockMutex(_mutex);
+    t.f(t.arg);
+    SDL_LockMutex(_mutex);
+    if(--_running == 0 && _count == 0)
+      SDL_CondBroadcast(_cond_idle);
+  }
+  SDL_UnlockMutex(_mutex);
+  return 0;
+}
+
+int wkInit(int nthreads) {
+  int i;
+  if(_nthreads)
+    return _nthreads;
+  if(nthreads <= 0)
+    nthreads = SDL_GetCPUCount() - 1;
+  if(nthreads < 1) nthreads = 1;
+  if(nthreads > WK_MAX_THREADS) nthreads = WK_MAX_THREADS;
+  _mutex = SDL_CreateMutex();
+  _cond_task = SDL_CreateCond();
+  _cond_room = SDL_CreateCond();
+  _cond_idle = SDL_CreateCond();
+  _stop = 0;
+  for(i = 0; i < nthreads; ++i)
+    if((_threads[_nthreads] = SDL_CreateThread(loop, "worker", NULL)))
+      ++_nthreads;
+  return _nthreads;
+}
+
+void wkSubmit(wk_func_t f, void * arg) {
+  if(!_nthreads) {
+    f(arg);
+    return;
+  }
+  SDL_LockMutex(_mutex);
+  while(_count == WK_QUEUE)
+    SDL_CondWait(_cond_room, _mutex);
+  _queue[(_head + _count) % WK_QUEUE].f = f;
+  _queue[(_head + _count) % WK_QUEUE].arg = arg;
+  ++_count;
+  SDL_CondSignal(_cond_task);
+  SDL_UnlockMutex(_mutex);
+}
+
+void wkWait(void) {
+  if(!_nthreads)
+    return;
+  SDL_LockMutex(_mutex);
+  while(_count || _running)
+    SDL_CondWait(_cond_idle, _mutex);
+  SDL_UnlockMutex(_mutex);
+}
+
+/* boucle parallèle partagée entre l'appelant et les threads ;
+ * rendue au pool par le dernier qui la lâche (une tâche peut démarrer
+ * bien après la fin de la boucle, derrière d'autres tâches de la
+ * file) : libre quand refs vaut 0 */
+typedef struct {
+  wk_range_t f;
+  void * arg;
+  int n, grain, chunks;
+  SDL_atomic_t next, done, refs;
+} job_t;
+
+/* pool des boucles : aucune allocation par appel */
+static job_t _jobs[WK_JOBS];
+
+/* prend et traite des morceaux tant qu'il en reste */
+static void travailler(job_t * j) {
+  int c;
+  while((c = SDL_AtomicAdd(&j->next, 1)) < j->chunks) {
+    int b = c * j->grain, e = b + j->grain;
+    j->f(j->arg, b, e < j->n ? e : j->n);
+    SDL_AtomicAdd(&j->done, 1);
+  }
+}
+
+static void lacher(job_t * j) {
+  SDL_AtomicAdd(&j->refs, -1);
+}
+
+/* prend une boucle libre du pool en la réservant pour \a refs
+ * utilisateurs, NULL si toutes sont encore référencées */
+static job_t * prendre(int refs) {
+  int i;
+  for(i = 0; i < WK_JOBS; ++i)
+    if(SDL_AtomicCAS(&_jobs[i].refs, 0, refs))
+      return &_jobs[i];
+  return NULL;
+}
+
+static void aider(void * arg) {
+  job_t * j = (job_t *)arg;
+  travailler(j);
+  lacher(j);
+}
+
+void wkParallelFor(int n, int grain, wk_range_t f, void * arg) {
+  job_t * j;
+  int i, chunks, aides, tours = 0;
+  if(n <= 0)
+    return;
+  if(grain < 1) grain = 1;
+  chunks = (n + grain - 1) / grain;
+  aides = chunks - 1 < _nthreads ? chunks - 1 : _nthreads;
+  /* un seul morceau, pas de pool ou boucles précédentes encore
+   * référencées (tâches en retard) : sur place */
+  if(aides <= 0 || !(j = prendre(aides + 1))) {
+    f(arg, 0, n);
+    return;
+  }
+  j->f = f;
+  j->arg = arg;
+  j->n = n;
+  j->grain = grain;
+  j->chunks = chunks;
+  SDL_AtomicSet(&j->next, 0);
+  SDL_AtomicSet(&j->done, 0);
+  for(i = 0; i < aides; ++i)
+    wkSubmit(aider, j);
+  travailler(j);
+  /* morceaux pris par les threads et pas encore terminés : courts,
+   * mais un thread préempté ne doit pas nous laisser brûler le cœur */
+  while(SDL_AtomicGet(&j->done) < chunks)
+    if(++tours < WK_SPINS)
+      SDL_CPUPauseInstruction();
+    else
+      SDL_Delay(0);
+  lacher(j);
+}
+
+int wkCount(void) {
+  return _nthreads;
+}
+
+void wkQuit(void) {
+  int i;
+  if(!_nthreads)
+    return;
+  SDL_LockMutex(_mutex);
+  _stop = 1;
+  SDL_CondBroadcast(_cond_task);
+  SDL_UnlockMutex(_mutex);
+  for(i = 0; i < _nthreads; ++i)
+    SDL_WaitThread(_threads[i], NULL);
+  _nthreads = 0;
+  SDL_DestroyCond(_cond_task);
+  SDL_DestroyCond(_cond_room);
+  SDL_DestroyCond(_cond_idle);
+  SDL_DestroyMutex(_mutex);
+  _mutex = NULL;
+  _cond_task = _cond_room = _cond_idle = NULL;
+}
@@ -0,0 +1,41 @@
+/*!\file workers.h
+ *
+ * \brief petit pool de threads de travail (threads SDL) : une file
+ * circulaire de tâches de taille fixe, sans allocation à la
+ * soumission.
+ */
+#ifndef _WORKERS_H
+#define _WORKERS_H
+
+/*!\brief nombre maximal de tâches en attente. */
+#define WK_QUEUE 1024
+/*!\brief nombre maximal de threads du pool. */
+#define WK_MAX_THREADS 16
+
+/*!\brief une tâche : fonction et son argument. */
+typedef void (*wk_func_t)(void * arg);
+/*!\brief un morceau [\a begin, \a end) d'une boucle parallèle. */
+typedef void (*wk_range_t)(void * arg, int begin, int end);
+
+/*!\brief démarre \a nthreads threads (0 : nombre de coeurs moins un,
+ * au moins 1). Retourne le nombre de threads démarrés. */
+extern int  wkInit(int nthreads);
+/*!\brief soumet la tâche \a f(\a arg) ; bloque si la file est
+ * pleine. Sans pool démarré, la tâche est exécutée sur place. */
+extern void wkSubmit(wk_func_t f, void * arg);
+/*!\brief attend que toutes les tâches soumises soient terminées. */
+extern void wkWait(void);
+/*!\brief exécute \a f(\a arg, begin, end) sur [0, \a n) découpé en
+ * morceaux d'au moins \a grain indices. L'appelant traite lui-même les
+ * morceaux que les threads n'ont pas encore pris : il n'attend jamais
+ * les autres tâches de la file (textures), seulement les morceaux en
+ * cours. Aucune allocation : la boucle vient d'un petit pool, et
+ * s'exécute sur place si toutes sont encore tenues par des tâches en
+ * retard. */
+extern void wkParallelFor(int n, int grain, wk_range_t f, void * arg);
+/*!\brief nombre de threads du pool. */
+extern int  wkCount(void);
+/*!\brief termine les tâches en cours et arrête le pool. */
+extern void wkQuit(void);
+
+#endif